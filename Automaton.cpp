@@ -0,0 +1,421 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "Automaton.h"
+#include <QtAlgorithms>
+#include <algorithm>
+using namespace Fts;
+
+static const int s_maxExplicit = 16; // mehr Zeichen pro Zustand werden nicht einzeln aufgezaehlt
+
+bool PatternAutomaton::CharClass::contains(QChar ch) const
+{
+	if( d_any )
+		return true;
+	const quint16 c = ch.unicode();
+	bool in = false;
+	for( int i = 0; i < d_ranges.size() && !in; i++ )
+		in = c >= d_ranges[i].first && c <= d_ranges[i].second;
+	return in != d_negated;
+}
+
+PatternAutomaton::PatternAutomaton(const QString & pattern, Syntax syntax):d_pattern(pattern),d_pos(0),d_accept(-1),d_start(0)
+{
+	Frag f;
+	if( syntax == Glob )
+		f = parseGlob();
+	else
+	{
+		f = parseAlt();
+		if( d_error.isEmpty() && d_pos < d_pattern.size() )
+			d_error = QString("unexpected '%1' at %2").arg( d_pattern[d_pos] ).arg( d_pos );
+	}
+	if( !d_error.isEmpty() )
+	{
+		// Automat ohne Treffer
+		d_nfa.clear();
+		f = Frag( addState(), addState() );
+	}
+	d_accept = f.second;
+	QVector<int> set;
+	set.append( f.first );
+	closure( set );
+	d_start = dfaState( set );
+}
+
+int PatternAutomaton::addState()
+{
+	d_nfa.append( NfaState() );
+	return d_nfa.size() - 1;
+}
+
+PatternAutomaton::Frag PatternAutomaton::atom(const CharClass & cls)
+{
+	const int a = addState();
+	const int b = addState();
+	Edge e;
+	e.d_to = b;
+	e.d_cls = cls;
+	d_nfa[a].d_edges.append( e );
+	return Frag( a, b );
+}
+
+PatternAutomaton::Frag PatternAutomaton::parseGlob()
+{
+	const int s = addState();
+	int cur = s;
+	while( d_pos < d_pattern.size() && d_error.isEmpty() )
+	{
+		const QChar ch = d_pattern[d_pos++];
+		CharClass cls;
+		if( ch == QChar('*') )
+		{
+			// Schlaufe auf einem eigenen Zustand
+			const int loop = addState();
+			d_nfa[cur].d_eps.append( loop );
+			cls.d_any = true;
+			Edge e;
+			e.d_to = loop;
+			e.d_cls = cls;
+			d_nfa[loop].d_edges.append( e );
+			cur = loop;
+			continue;
+		}else if( ch == QChar('?') )
+			cls.d_any = true;
+		else if( ch == QChar('[') )
+		{
+			if( !parseClass( cls ) )
+				break;
+		}else
+		{
+			QChar c = ch;
+			if( ch == QChar('\\') && d_pos < d_pattern.size() )
+				c = d_pattern[d_pos++];
+			cls.d_ranges.append( qMakePair( c.unicode(), c.unicode() ) );
+		}
+		const Frag f = atom( cls );
+		d_nfa[cur].d_eps.append( f.first );
+		cur = f.second;
+	}
+	return Frag( s, cur );
+}
+
+bool PatternAutomaton::parseClass(CharClass & cls)
+{
+	// d_pos steht nach '['
+	if( d_pos < d_pattern.size() && ( d_pattern[d_pos] == QChar('^') || d_pattern[d_pos] == QChar('!') ) )
+	{
+		cls.d_negated = true;
+		d_pos++;
+	}
+	bool first = true;
+	while( d_pos < d_pattern.size() && ( first || d_pattern[d_pos] != QChar(']') ) )
+	{
+		first = false;
+		QChar from = d_pattern[d_pos++];
+		if( from == QChar('\\') && d_pos < d_pattern.size() )
+			from = d_pattern[d_pos++];
+		QChar to = from;
+		if( d_pos + 1 < d_pattern.size() && d_pattern[d_pos] == QChar('-') && d_pattern[d_pos+1] != QChar(']') )
+		{
+			to = d_pattern[d_pos+1];
+			d_pos += 2;
+		}
+		if( to < from )
+			qSwap( from, to );
+		cls.d_ranges.append( qMakePair( from.unicode(), to.unicode() ) );
+	}
+	if( d_pos >= d_pattern.size() )
+	{
+		d_error = "missing ']'";
+		return false;
+	}
+	d_pos++; // ']'
+	return true;
+}
+
+PatternAutomaton::Frag PatternAutomaton::parseAlt()
+{
+	Frag f = parseConcat();
+	while( d_error.isEmpty() && d_pos < d_pattern.size() && d_pattern[d_pos] == QChar('|') )
+	{
+		d_pos++;
+		const Frag g = parseConcat();
+		const int s = addState();
+		const int e = addState();
+		d_nfa[s].d_eps << f.first << g.first;
+		d_nfa[f.second].d_eps.append( e );
+		d_nfa[g.second].d_eps.append( e );
+		f = Frag( s, e );
+	}
+	return f;
+}
+
+PatternAutomaton::Frag PatternAutomaton::parseConcat()
+{
+	const int s = addState();
+	int cur = s;
+	while( d_error.isEmpty() && d_pos < d_pattern.size() &&
+		   d_pattern[d_pos] != QChar('|') && d_pattern[d_pos] != QChar(')') )
+	{
+		const Frag f = parseRepeat();
+		d_nfa[cur].d_eps.append( f.first );
+		cur = f.second;
+	}
+	return Frag( s, cur );
+}
+
+PatternAutomaton::Frag PatternAutomaton::parseRepeat()
+{
+	Frag f = parseAtom();
+	while( d_error.isEmpty() && d_pos < d_pattern.size() )
+	{
+		const QChar q = d_pattern[d_pos];
+		if( q != QChar('*') && q != QChar('+') && q != QChar('?') )
+			break;
+		d_pos++;
+		const int s = addState();
+		const int e = addState();
+		d_nfa[s].d_eps.append( f.first );
+		d_nfa[f.second].d_eps.append( e );
+		if( q != QChar('+') )
+			d_nfa[s].d_eps.append( e ); // darf fehlen
+		if( q != QChar('?') )
+			d_nfa[f.second].d_eps.append( f.first ); // darf sich wiederholen
+		f = Frag( s, e );
+	}
+	return f;
+}
+
+PatternAutomaton::Frag PatternAutomaton::parseAtom()
+{
+	const QChar ch = d_pattern[d_pos++];
+	CharClass cls;
+	if( ch == QChar('(') )
+	{
+		const Frag f = parseAlt();
+		if( d_pos >= d_pattern.size() || d_pattern[d_pos] != QChar(')') )
+		{
+			if( d_error.isEmpty() )
+				d_error = "missing ')'";
+			return f;
+		}
+		d_pos++;
+		return f;
+	}else if( ch == QChar('*') || ch == QChar('+') || ch == QChar('?') )
+	{
+		d_error = QString("nothing to repeat at %1").arg( d_pos - 1 );
+		return Frag( addState(), addState() );
+	}else if( ch == QChar('.') )
+		cls.d_any = true;
+	else if( ch == QChar('[') )
+		parseClass( cls );
+	else
+	{
+		QChar c = ch;
+		if( ch == QChar('\\') && d_pos < d_pattern.size() )
+			c = d_pattern[d_pos++];
+		cls.d_ranges.append( qMakePair( c.unicode(), c.unicode() ) );
+	}
+	return atom( cls );
+}
+
+void PatternAutomaton::closure(QVector<int> & set) const
+{
+	QVector<quint8> seen( d_nfa.size(), 0 );
+	for( int i = 0; i < set.size(); i++ )
+		seen[set[i]] = 1;
+	for( int i = 0; i < set.size(); i++ )
+	{
+		const QList<int>& eps = d_nfa[set[i]].d_eps;
+		for( int j = 0; j < eps.size(); j++ )
+		{
+			if( !seen[eps[j]] )
+			{
+				seen[eps[j]] = 1;
+				set.append( eps[j] );
+			}
+		}
+	}
+	qSort( set );
+}
+
+int PatternAutomaton::dfaState(const QVector<int> & set) const
+{
+	const QByteArray key( reinterpret_cast<const char*>( set.constData() ), set.size() * int(sizeof(int)) );
+	QHash<QByteArray,int>::const_iterator i = d_dfaIndex.find( key );
+	if( i != d_dfaIndex.end() )
+		return i.value();
+	DfaState s;
+	s.d_set = set;
+	s.d_accept = std::binary_search( set.begin(), set.end(), d_accept );
+	d_dfa.append( s );
+	d_dfaIndex.insert( key, d_dfa.size() - 1 );
+	return d_dfa.size() - 1;
+}
+
+int PatternAutomaton::step(int state, QChar ch) const
+{
+	if( state < 0 )
+		return -1;
+	const quint64 key = ( quint64(state) << 16 ) | ch.unicode();
+	QHash<quint64,int>::const_iterator i = d_trans.find( key );
+	if( i != d_trans.end() )
+		return i.value();
+	QVector<int> next;
+	const QVector<int> set = d_dfa[state].d_set; // Kopie, da dfaState d_dfa veraendert
+	for( int k = 0; k < set.size(); k++ )
+	{
+		const QList<Edge>& edges = d_nfa[set[k]].d_edges;
+		for( int j = 0; j < edges.size(); j++ )
+		{
+			if( edges[j].d_cls.contains( ch ) && !next.contains( edges[j].d_to ) )
+				next.append( edges[j].d_to );
+		}
+	}
+	int res = -1;
+	if( !next.isEmpty() )
+	{
+		closure( next );
+		res = dfaState( next );
+	}
+	d_trans.insert( key, res );
+	return res;
+}
+
+bool PatternAutomaton::explicitChars(int state, QList<QChar> & out) const
+{
+	if( state < 0 )
+		return true;
+	const QVector<int>& set = d_dfa[state].d_set;
+	for( int k = 0; k < set.size(); k++ )
+	{
+		const QList<Edge>& edges = d_nfa[set[k]].d_edges;
+		for( int j = 0; j < edges.size(); j++ )
+		{
+			const CharClass& cls = edges[j].d_cls;
+			if( cls.d_any || cls.d_negated )
+				return false;
+			for( int r = 0; r < cls.d_ranges.size(); r++ )
+			{
+				for( int c = cls.d_ranges[r].first; c <= cls.d_ranges[r].second; c++ )
+				{
+					if( !out.contains( QChar( quint16(c) ) ) )
+					{
+						if( out.size() >= s_maxExplicit )
+							return false;
+						out.append( QChar( quint16(c) ) );
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+LevenshteinAutomaton::LevenshteinAutomaton(const QString & term, int maxEdits, bool transpositions):
+	d_term(term),d_max(maxEdits),d_trans(transpositions)
+{
+	const int n = d_term.size();
+	QByteArray row( n + 1, 0 );
+	for( int i = 0; i <= n; i++ )
+		row[i] = char( qMin( i, d_max + 1 ) );
+	if( d_trans )
+	{
+		row += QByteArray( n + 1, char( d_max + 1 ) ); // keine vorherige Zeile
+		row += QByteArray( 2, 0 );
+	}
+	intern( row );
+}
+
+int LevenshteinAutomaton::intern(const QByteArray & state) const
+{
+	QHash<QByteArray,int>::const_iterator i = d_index.find( state );
+	if( i != d_index.end() )
+		return i.value();
+	d_states.append( state );
+	d_index.insert( state, d_states.size() - 1 );
+	return d_states.size() - 1;
+}
+
+int LevenshteinAutomaton::step(int state, QChar ch) const
+{
+	if( state < 0 )
+		return -1;
+	const quint64 key = ( quint64(state) << 16 ) | ch.unicode();
+	QHash<quint64,int>::const_iterator i = d_next.find( key );
+	if( i != d_next.end() )
+		return i.value();
+
+	const int n = d_term.size();
+	const char limit = char( d_max + 1 );
+	const QByteArray cur = d_states[state];
+	QByteArray next( cur.size(), 0 );
+	next[0] = char( qMin( cur[0] + 1, int(limit) ) );
+	char best = next[0];
+	for( int k = 1; k <= n; k++ )
+	{
+		int v = qMin( cur[k] + 1, next[k-1] + 1 );
+		v = qMin( v, cur[k-1] + ( ( d_term[k-1] == ch ) ? 0 : 1 ) );
+		if( d_trans && k > 1 && d_term[k-1] == QChar( quint16( ( quint8(cur[2*n+2]) << 8 ) | quint8(cur[2*n+3]) ) ) &&
+				d_term[k-2] == ch )
+			v = qMin( v, cur[n+1+k-2] + 1 );
+		next[k] = char( qMin( v, int(limit) ) );
+		best = qMin( best, next[k] );
+	}
+	int res = -1;
+	if( best <= d_max )
+	{
+		if( d_trans )
+		{
+			for( int k = 0; k <= n; k++ )
+				next[n+1+k] = cur[k];
+			next[2*n+2] = char( ch.unicode() >> 8 );
+			next[2*n+3] = char( ch.unicode() & 0xff );
+		}
+		res = intern( next );
+	}
+	d_next.insert( key, res );
+	return res;
+}
+
+bool LevenshteinAutomaton::isAccepting(int state) const
+{
+	return state >= 0 && d_states[state][d_term.size()] <= d_max;
+}
+
+bool LevenshteinAutomaton::explicitChars(int state, QList<QChar> & out) const
+{
+	if( state < 0 )
+		return true;
+	// Nur wenn kein Edit mehr moeglich ist, kommen bloss noch die Zeichen des Terms in Frage
+	const int n = d_term.size();
+	const QByteArray& s = d_states[state];
+	for( int k = 0; k <= n; k++ )
+	{
+		if( s[k] < d_max || ( d_trans && s[n+1+k] < d_max ) )
+			return false;
+	}
+	for( int k = 0; k < n; k++ )
+	{
+		if( s[k] == d_max && !out.contains( d_term[k] ) )
+			out.append( d_term[k] );
+	}
+	return true;
+}
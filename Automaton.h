@@ -0,0 +1,131 @@
+#ifndef AUTOMATON_H
+#define AUTOMATON_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+
+namespace Fts
+{
+	// Deterministischer Automat ueber die Zeichen eines Terms, siehe IndexEngine::automatonIds.
+	// Zustaende sind Zahlen >= 0, -1 ist der tote Zustand.
+	class Automaton
+	{
+	public:
+		virtual ~Automaton() {}
+		virtual int start() const = 0;
+		virtual int step( int state, QChar ) const = 0;
+		virtual bool isAccepting( int state ) const = 0;
+		// Alle Zeichen, mit denen state nicht in den toten Zustand geht; false, wenn es zu viele oder
+		// beliebige sind. Damit kann der Aufrufer statt eines ganzen Bereichs nur die Teilbereiche lesen.
+		virtual bool explicitChars( int state, QList<QChar>& ) const { Q_UNUSED(state); return false; }
+	};
+
+	// Glob (* ? [..]) oder einfacher regulaerer Ausdruck (. [..] [^..] * + ? | ( ) und \ als Escape),
+	// der immer auf den ganzen Term passen muss. Wird als NFA uebersetzt; die DFA-Zustaende entstehen
+	// erst beim Durchlaufen aus Mengen von NFA-Zustaenden.
+	class PatternAutomaton : public Automaton
+	{
+	public:
+		enum Syntax { Glob, RegExp };
+		PatternAutomaton( const QString& pattern, Syntax );
+		bool isValid() const { return d_error.isEmpty(); }
+		const QString& getError() const { return d_error; }
+
+		int start() const { return d_start; }
+		int step( int state, QChar ) const;
+		bool isAccepting( int state ) const { return state >= 0 && d_dfa[state].d_accept; }
+		bool explicitChars( int state, QList<QChar>& ) const;
+	private:
+		struct CharClass
+		{
+			QList<QPair<quint16,quint16> > d_ranges;
+			bool d_any;
+			bool d_negated;
+			CharClass():d_any(false),d_negated(false) {}
+			bool contains( QChar ) const;
+		};
+		struct Edge
+		{
+			int d_to;
+			CharClass d_cls;
+		};
+		struct NfaState
+		{
+			QList<Edge> d_edges;
+			QList<int> d_eps;
+		};
+		struct DfaState
+		{
+			QVector<int> d_set; // sortierte NFA-Zustaende
+			bool d_accept;
+		};
+		typedef QPair<int,int> Frag; // Anfang und Ende eines NFA-Teilstuecks
+		int addState();
+		Frag atom( const CharClass& );
+		Frag parseAlt();
+		Frag parseConcat();
+		Frag parseRepeat();
+		Frag parseAtom();
+		Frag parseGlob();
+		bool parseClass( CharClass& );
+		void closure( QVector<int>& ) const;
+		int dfaState( const QVector<int>& ) const;
+
+		QString d_pattern;
+		int d_pos;
+		QString d_error;
+		QList<NfaState> d_nfa;
+		int d_accept;
+		int d_start;
+		mutable QList<DfaState> d_dfa;
+		mutable QHash<QByteArray,int> d_dfaIndex; // Menge -> DFA-Zustand
+		mutable QHash<quint64,int> d_trans; // (Zustand, Zeichen) -> Zustand
+	};
+
+	// Akzeptiert alle Terme mit hoechstens maxEdits Einfuegungen, Loeschungen und Ersetzungen gegenueber dem
+	// Term, optional auch Vertauschungen benachbarter Zeichen (Damerau, optimal string alignment).
+	// Ein Zustand ist die auf maxEdits+1 begrenzte Zeile der Distanzmatrix; die Zustaende werden erst beim
+	// Durchlaufen erzeugt. Nach Schulz/Mihov, Fast String Correction with Levenshtein-Automata, 2002.
+	class LevenshteinAutomaton : public Automaton
+	{
+	public:
+		LevenshteinAutomaton( const QString& term, int maxEdits, bool transpositions );
+		int start() const { return 0; }
+		int step( int state, QChar ) const;
+		bool isAccepting( int state ) const;
+		bool explicitChars( int state, QList<QChar>& ) const;
+	private:
+		int intern( const QByteArray& ) const;
+		QString d_term;
+		int d_max;
+		bool d_trans;
+		// Zeile, bei Vertauschungen gefolgt von der vorherigen Zeile und dem letzten Zeichen
+		mutable QList<QByteArray> d_states;
+		mutable QHash<QByteArray,int> d_index;
+		mutable QHash<quint64,int> d_next;
+	};
+}
+
+#endif // AUTOMATON_H
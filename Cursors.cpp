@@ -0,0 +1,715 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "Cursors.h"
+#include <limits>
+#include <algorithm>
+#include <math.h>
+using namespace Fts;
+
+static const double s_scoreScale = 1000.0; // wie in IndexEngine
+static const int s_lengthScanRatio = 8; // ab einem Achtel aller Docs lohnt sich der Durchgang durch alle Laengen
+
+Udb::OID Cursor::endDoc()
+{
+	return std::numeric_limits<Udb::OID>::max();
+}
+
+// Quelle: Robertson/Zaragoza, The Probabilistic Relevance Framework: BM25 and Beyond, 2009;
+// idf wie in Lucene mit +1, damit sehr haeufige Terme nicht negativ werden.
+Scorer::Scorer(const IndexEngine * eng, quint32 tid):d_bm25(false),d_idf(0),d_k1(0),d_b(0),d_avgLen(1)
+{
+	if( eng->getScoring() != IndexEngine::Bm25Scoring )
+		return;
+	d_bm25 = true;
+	const double n = eng->getDocCount();
+	const quint64 total = eng->getTotalLength();
+	const double df = eng->getTermStats( tid ).d_df;
+	d_idf = ::log( 1.0 + ( n - df + 0.5 ) / ( df + 0.5 ) );
+	d_k1 = eng->d_k1;
+	d_b = eng->d_b;
+	d_avgLen = ( n == 0 || total == 0 ) ? 1.0 : total / n;
+}
+
+quint32 Scorer::score(quint32 tf, quint32 len) const
+{
+	if( !d_bm25 )
+		return tf;
+	const double l = ( len == 0 ) ? d_avgLen : len; // Docs aus Indizes ohne Laengen
+	const double s = d_idf * tf * ( d_k1 + 1.0 ) / ( tf + d_k1 * ( 1.0 - d_b + d_b * l / d_avgLen ) );
+	return quint32( s * s_scoreScale + 0.5 );
+}
+
+quint32 Scorer::bound(quint32 tf) const
+{
+	if( !d_bm25 )
+		return tf;
+	// score waechst mit tf und faellt mit der Laenge; die Schranke ist der Wert fuer Laenge 0
+	const double s = d_idf * tf * ( d_k1 + 1.0 ) / ( tf + d_k1 * ( 1.0 - d_b ) );
+	return quint32( s * s_scoreScale ) + 1;
+}
+
+LengthReader::LengthReader(const IndexEngine * eng, int docs):d_eng(eng),d_git(0),d_more(false)
+{
+	if( quint64(docs) * s_lengthScanRatio < eng->getDocCount() )
+		return;
+	QMutexLocker lock( &d_eng->d_dbLock );
+	d_git = new Udb::Git( eng->findLengths() );
+	d_more = !d_git->isNull();
+}
+
+LengthReader::~LengthReader()
+{
+	if( d_git == 0 )
+		return;
+	QMutexLocker lock( &d_eng->d_dbLock );
+	delete d_git;
+}
+
+quint32 LengthReader::length(Udb::OID doc)
+{
+	QMutexLocker lock( &d_eng->d_dbLock );
+	return read( doc );
+}
+
+QVector<quint32> LengthReader::lengths(const QVector<Udb::OID> & docs)
+{
+	QVector<quint32> res( docs.size() );
+	QMutexLocker lock( &d_eng->d_dbLock );
+	for( int i = 0; i < docs.size(); i++ )
+		res[i] = read( docs[i] );
+	return res;
+}
+
+quint32 LengthReader::read(Udb::OID doc)
+{
+	if( d_git == 0 )
+		return d_eng->readDocLength( doc );
+	// Merge-Join; die Laengen stehen wie die Postings nach OID geordnet
+	while( d_more )
+	{
+		quint32 tid = 0;
+		Udb::OID cur = 0, item = 0;
+		if( IndexEngine::readPostingKey( d_git->getKey(), tid, cur, item ) == 2 && cur >= doc )
+			return ( cur == doc ) ? IndexEngine::readPostingFreq( d_git->getValue() ) : 0;
+		d_more = d_git->nextKey();
+	}
+	return 0;
+}
+
+TermCursor::TermCursor(const IndexEngine * eng, quint32 tid):
+	d_eng(eng),d_tid(tid),d_scorer(eng,tid),d_cur(0),d_pos(0),d_shallow(0),d_maxScore(0),d_scored(false),d_lengths(0)
+{
+	if( eng->getPostingFormat() == IndexEngine::BlockFormat )
+	{
+		PostingCodec::Head head;
+		PostingCodec::readHead( eng->readHeadCell( tid ), head );
+		d_blocks = head.d_blocks;
+		for( int i = 0; i < head.d_pages.size(); i++ )
+			PostingCodec::readPage( eng->readBlockCell( tid, head.d_pages[i].d_no ), d_blocks );
+		quint32 maxFreq = 0;
+		for( int i = 0; i < d_blocks.size(); i++ )
+			maxFreq = qMax( maxFreq, d_blocks[i].d_maxFreq );
+		d_maxScore = d_scorer.bound( maxFreq );
+		if( d_scorer.usesLength() )
+		{
+			int df = 0;
+			for( int i = 0; i < d_blocks.size(); i++ )
+				df += d_blocks[i].d_count;
+			d_lengths = new LengthReader( eng, df );
+		}
+		load( 0 );
+		return;
+	}
+	d_buf = eng->readHits( tid, false );
+	if( d_buf.isEmpty() )
+		return;
+	if( d_scorer.usesLength() )
+		d_lengths = new LengthReader( eng, d_buf.size() );
+	PostingCodec::BlockRef b;
+	b.d_no = 0;
+	b.d_first = d_buf.doc( 0 );
+	b.d_last = d_buf.doc( d_buf.size() - 1 );
+	b.d_count = d_buf.size();
+	b.d_maxFreq = 0;
+	for( int i = 0; i < d_buf.size(); i++ )
+		b.d_maxFreq = qMax( b.d_maxFreq, d_buf.rank( i ) );
+	d_blocks.append( b );
+	d_maxScore = d_scorer.bound( b.d_maxFreq );
+}
+
+TermCursor::TermCursor(const IndexEngine * eng, const HitList & scored):
+	d_eng(eng),d_tid(0),d_buf(scored),d_cur(0),d_pos(0),d_shallow(0),d_maxScore(0),d_scored(true),d_lengths(0)
+{
+	if( d_buf.isEmpty() )
+		return;
+	PostingCodec::BlockRef b;
+	b.d_no = 0;
+	b.d_first = d_buf.doc( 0 );
+	b.d_last = d_buf.doc( d_buf.size() - 1 );
+	b.d_count = d_buf.size();
+	b.d_maxFreq = 0;
+	for( int i = 0; i < d_buf.size(); i++ )
+		b.d_maxFreq = qMax( b.d_maxFreq, d_buf.rank( i ) );
+	d_blocks.append( b );
+	d_maxScore = b.d_maxFreq;
+}
+
+TermCursor::~TermCursor()
+{
+	delete d_lengths;
+}
+
+Udb::OID TermCursor::doc() const
+{
+	if( atEnd() )
+		return endDoc();
+	return d_buf.doc( d_pos );
+}
+
+quint32 TermCursor::score() const
+{
+	if( d_scored )
+		return d_buf.rank( d_pos );
+	const quint32 tf = d_buf.rank( d_pos );
+	return d_scorer.score( tf, ( d_lengths ) ? d_lengths->length( d_buf.doc( d_pos ) ) : 0 );
+}
+
+void TermCursor::load(int block)
+{
+	d_cur = block;
+	d_pos = 0;
+	if( d_tid == 0 || d_eng->getPostingFormat() != IndexEngine::BlockFormat )
+		return; // die ganze Liste ist bereits in d_buf
+	d_buf.clear();
+	while( d_cur < d_blocks.size() )
+	{
+		PostingCodec::readBlock( d_eng->readBlockCell( d_tid, d_blocks[d_cur].d_no ), d_buf );
+		if( !d_buf.isEmpty() )
+			return;
+		d_cur++; // leerer Block, sollte nicht vorkommen
+	}
+}
+
+void TermCursor::next()
+{
+	if( atEnd() )
+		return;
+	d_pos++;
+	if( d_pos >= d_buf.size() )
+	{
+		if( d_cur + 1 < d_blocks.size() && d_tid != 0 && d_eng->getPostingFormat() == IndexEngine::BlockFormat )
+			load( d_cur + 1 );
+		else
+			d_cur = d_blocks.size();
+	}
+}
+
+void TermCursor::advanceTo(Udb::OID target)
+{
+	if( atEnd() || doc() >= target )
+		return;
+	if( target > d_blocks[d_cur].d_last )
+	{
+		const int b = PostingCodec::findBlock( d_blocks, target, d_cur + 1 );
+		if( b >= d_blocks.size() )
+		{
+			d_cur = d_blocks.size();
+			return;
+		}
+		load( b );
+		if( atEnd() )
+			return;
+	}
+	// galoppierend im dekodierten Block; d_last >= target, also wird ein Doc gefunden
+	int lo = d_pos, hi = d_pos, step = 1;
+	const int n = d_buf.size();
+	while( hi < n && d_buf.doc( hi ) < target )
+	{
+		lo = hi + 1;
+		hi += step;
+		step *= 2;
+	}
+	if( hi > n )
+		hi = n;
+	while( lo < hi )
+	{
+		const int mid = lo + ( hi - lo ) / 2;
+		if( d_buf.doc( mid ) < target )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	d_pos = lo;
+	if( d_pos >= n )
+	{
+		d_pos--;
+		next(); // nur bei inkonsistentem Verzeichnis
+	}
+}
+
+bool TermCursor::mayContain(Udb::OID target) const
+{
+	if( atEnd() )
+		return false;
+	if( target <= d_blocks[d_cur].d_last )
+		return true; // im dekodierten Block entscheidet advanceTo
+	const int b = PostingCodec::findBlock( d_blocks, target, d_cur + 1 );
+	return b < d_blocks.size() && d_blocks[b].d_first <= target;
+}
+
+void TermCursor::seekBlock(Udb::OID target)
+{
+	if( d_shallow < d_cur )
+		d_shallow = d_cur;
+	if( d_shallow < d_blocks.size() && d_blocks[d_shallow].d_last < target )
+		d_shallow = PostingCodec::findBlock( d_blocks, target, d_shallow + 1 );
+}
+
+quint32 TermCursor::blockMax() const
+{
+	if( d_shallow >= d_blocks.size() )
+		return 0;
+	if( d_scored )
+		return d_blocks[d_shallow].d_maxFreq;
+	return d_scorer.bound( d_blocks[d_shallow].d_maxFreq );
+}
+
+Udb::OID TermCursor::blockLast() const
+{
+	if( d_shallow >= d_blocks.size() )
+		return endDoc();
+	return d_blocks[d_shallow].d_last;
+}
+
+static bool _lessDoc( const TermCursor* lhs, const TermCursor* rhs )
+{
+	return lhs->doc() < rhs->doc();
+}
+
+static bool _greaterHit( const TermCursor::Hit& lhs, const TermCursor::Hit& rhs )
+{
+	return lhs.first > rhs.first || ( lhs.first == rhs.first && lhs.second < rhs.second );
+}
+
+QList<TermCursor::Hit> TermCursor::topK(const QList<TermCursor*> & cursors, int k)
+{
+	QList<Hit> res;
+	if( k <= 0 )
+		return res;
+	QVector<TermCursor*> c;
+	for( int i = 0; i < cursors.size(); i++ )
+	{
+		if( !cursors[i]->atEnd() )
+			c.append( cursors[i] );
+	}
+	// Min-Heap der bisher k besten; theta ist die Bewertung, die ein neues Doc uebertreffen muss
+	QVector<Hit> heap;
+	heap.reserve( k );
+	qint64 theta = -1;
+	while( true )
+	{
+		std::sort( c.begin(), c.end(), _lessDoc );
+		while( !c.isEmpty() && c.last()->atEnd() )
+			c.pop_back();
+		if( c.isEmpty() )
+			break;
+
+		// Pivot: erster Cursor, ab dem die Summe der Schranken theta uebersteigt
+		qint64 acc = 0;
+		int p = -1;
+		for( int i = 0; i < c.size(); i++ )
+		{
+			acc += c[i]->maxScore();
+			if( acc > theta )
+			{
+				p = i;
+				break;
+			}
+		}
+		if( p < 0 )
+			break;
+		const Udb::OID pivot = c[p]->doc();
+		while( p + 1 < c.size() && c[p + 1]->doc() == pivot )
+			p++;
+
+		qint64 blockSum = 0;
+		for( int i = 0; i <= p; i++ )
+		{
+			c[i]->seekBlock( pivot );
+			blockSum += c[i]->blockMax();
+		}
+		if( blockSum > theta )
+		{
+			if( c[0]->doc() == pivot )
+			{
+				// alle Cursor bis p stehen auf dem Pivot
+				qint64 s = 0;
+				for( int i = 0; i <= p; i++ )
+					s += c[i]->score();
+				if( s > theta )
+				{
+					const Hit h( quint32( qMin( s, qint64(std::numeric_limits<quint32>::max()) ) ), pivot );
+					if( heap.size() == k )
+					{
+						std::pop_heap( heap.begin(), heap.end(), _greaterHit );
+						heap.pop_back();
+					}
+					heap.append( h );
+					std::push_heap( heap.begin(), heap.end(), _greaterHit );
+					if( heap.size() == k )
+						theta = heap.first().first;
+				}
+				for( int i = 0; i <= p; i++ )
+					c[i]->next();
+			}else
+			{
+				for( int i = 0; i < p; i++ )
+					c[i]->advanceTo( pivot );
+			}
+		}else
+		{
+			// Kein Doc vor dem Ende der aktuellen Bloecke kann noch unter die ersten k kommen
+			Udb::OID next = endDoc();
+			for( int i = 0; i <= p; i++ )
+			{
+				const Udb::OID last = c[i]->blockLast();
+				if( last != endDoc() )
+					next = qMin( next, last + 1 );
+			}
+			if( p + 1 < c.size() )
+				next = qMin( next, c[p + 1]->doc() );
+			for( int i = 0; i <= p; i++ )
+				c[i]->advanceTo( next );
+		}
+	}
+	std::sort( heap.begin(), heap.end(), _greaterHit );
+	for( int i = 0; i < heap.size(); i++ )
+		res.append( heap[i] );
+	return res;
+}
+
+PostingCursor::PostingCursor(const IndexEngine * eng, quint32 tid):
+	d_eng(eng),d_tid(tid),d_scorer(eng,tid),d_doc(0),d_freq(0),d_lengths(0)
+{
+	if( d_scorer.usesLength() )
+		d_lengths = new LengthReader( eng, eng->readTermStats( tid ).d_df );
+	QMutexLocker lock( &d_eng->d_dbLock );
+	d_git = new Udb::Git( eng->findPostings(tid) );
+	d_more = !d_git->isNull();
+	fetch();
+}
+
+PostingCursor::~PostingCursor()
+{
+	delete d_lengths;
+	QMutexLocker lock( &d_eng->d_dbLock );
+	delete d_git;
+}
+
+quint32 PostingCursor::rank() const
+{
+	return d_scorer.score( d_freq, ( d_lengths ) ? d_lengths->length( d_doc ) : 0 );
+}
+
+void PostingCursor::fetch()
+{
+	// Zuerst kommt die Statistik, dann pro Doc der DocHit gefolgt von seinen ItemHits; unter d_dbLock
+	d_doc = endDoc();
+	while( d_more )
+	{
+		quint32 tid = 0;
+		Udb::OID doc = 0, item = 0;
+		if( IndexEngine::readPostingKey( d_git->getKey(), tid, doc, item ) == 2 )
+		{
+			d_doc = doc;
+			d_freq = IndexEngine::readPostingFreq( d_git->getValue() );
+			return;
+		}
+		d_more = d_git->nextKey();
+	}
+}
+
+void PostingCursor::next()
+{
+	if( d_doc == endDoc() )
+		return;
+	QMutexLocker lock( &d_eng->d_dbLock );
+	d_more = d_git->nextKey();
+	fetch();
+}
+
+void PostingCursor::advanceTo(Udb::OID target)
+{
+	while( d_doc < target )
+		next();
+}
+
+AndCursor::AndCursor(const QList<Cursor*> & subs):d_subs(subs),d_doc(0),d_rank(0)
+{
+	align( 0 );
+}
+
+AndCursor::~AndCursor()
+{
+	qDeleteAll( d_subs );
+}
+
+void AndCursor::align(Udb::OID target)
+{
+	// Leapfrog: jeder Cursor, der ueber target hinaus steht, gibt das neue target vor
+	d_rank = 0;
+	if( d_subs.isEmpty() )
+	{
+		d_doc = endDoc();
+		return;
+	}
+	int agree = 0;
+	int i = 0;
+	while( agree < d_subs.size() )
+	{
+		Cursor* c = d_subs[i];
+		c->advanceTo( target );
+		if( c->doc() == endDoc() )
+		{
+			d_doc = endDoc();
+			return;
+		}
+		if( c->doc() > target )
+		{
+			target = c->doc();
+			agree = 1;
+		}else
+			agree++;
+		i = ( i + 1 ) % d_subs.size();
+	}
+	d_doc = target;
+	for( int j = 0; j < d_subs.size(); j++ )
+		d_rank += d_subs[j]->rank();
+}
+
+void AndCursor::next()
+{
+	if( d_doc == endDoc() )
+		return;
+	align( d_doc + 1 );
+}
+
+void AndCursor::advanceTo(Udb::OID target)
+{
+	if( d_doc >= target )
+		return;
+	align( target );
+}
+
+bool AndCursor::mayContain(Udb::OID target) const
+{
+	for( int i = 0; i < d_subs.size(); i++ )
+	{
+		if( !d_subs[i]->mayContain( target ) )
+			return false;
+	}
+	return !d_subs.isEmpty();
+}
+
+OrCursor::OrCursor(const QList<Cursor*> & subs):d_subs(subs),d_doc(0),d_rank(0)
+{
+	for( int i = 0; i < d_subs.size(); i++ )
+	{
+		if( !d_subs[i]->atEnd() )
+			d_heap.append( d_subs[i] );
+	}
+	for( int i = d_heap.size() / 2 - 1; i >= 0; i-- )
+		siftDown( i );
+	settle();
+}
+
+OrCursor::~OrCursor()
+{
+	qDeleteAll( d_subs );
+}
+
+void OrCursor::siftDown(int i)
+{
+	const int n = d_heap.size();
+	Cursor* c = d_heap[i];
+	const Udb::OID doc = c->doc();
+	while( true )
+	{
+		int child = 2 * i + 1;
+		if( child >= n )
+			break;
+		if( child + 1 < n && d_heap[child + 1]->doc() < d_heap[child]->doc() )
+			child++;
+		if( d_heap[child]->doc() >= doc )
+			break;
+		d_heap[i] = d_heap[child];
+		i = child;
+	}
+	d_heap[i] = c;
+}
+
+void OrCursor::removeTop()
+{
+	d_heap[0] = d_heap.last();
+	d_heap.pop_back();
+	if( !d_heap.isEmpty() )
+		siftDown( 0 );
+}
+
+quint32 OrCursor::rankAt(int i) const
+{
+	// Alle Cursor auf d_doc bilden einen Teilbaum ab der Wurzel
+	if( i >= d_heap.size() || d_heap[i]->doc() != d_doc )
+		return 0;
+	return d_heap[i]->rank() + rankAt( 2 * i + 1 ) + rankAt( 2 * i + 2 );
+}
+
+void OrCursor::settle()
+{
+	if( d_heap.isEmpty() )
+	{
+		d_doc = endDoc();
+		d_rank = 0;
+		return;
+	}
+	d_doc = d_heap[0]->doc();
+	d_rank = rankAt( 0 );
+}
+
+void OrCursor::next()
+{
+	if( d_heap.isEmpty() )
+		return;
+	while( !d_heap.isEmpty() && d_heap[0]->doc() == d_doc )
+	{
+		d_heap[0]->next();
+		if( d_heap[0]->atEnd() )
+			removeTop();
+		else
+			siftDown( 0 );
+	}
+	settle();
+}
+
+void OrCursor::advanceTo(Udb::OID target)
+{
+	if( d_doc >= target )
+		return;
+	while( !d_heap.isEmpty() && d_heap[0]->doc() < target )
+	{
+		d_heap[0]->advanceTo( target );
+		if( d_heap[0]->atEnd() )
+			removeTop();
+		else
+			siftDown( 0 );
+	}
+	settle();
+}
+
+AndNotCursor::AndNotCursor(Cursor * include, Cursor * exclude):d_inc(include),d_exc(exclude)
+{
+	settle();
+}
+
+AndNotCursor::~AndNotCursor()
+{
+	delete d_inc;
+	delete d_exc;
+}
+
+void AndNotCursor::settle()
+{
+	while( !d_inc->atEnd() )
+	{
+		const Udb::OID doc = d_inc->doc();
+		if( !d_exc->mayContain( doc ) )
+			return;
+		d_exc->advanceTo( doc );
+		if( d_exc->doc() != doc )
+			return;
+		d_inc->next();
+	}
+}
+
+void AndNotCursor::next()
+{
+	if( d_inc->atEnd() )
+		return;
+	d_inc->next();
+	settle();
+}
+
+void AndNotCursor::advanceTo(Udb::OID target)
+{
+	if( d_inc->doc() >= target )
+		return;
+	d_inc->advanceTo( target );
+	settle();
+}
+
+bool OrCursor::mayContain(Udb::OID target) const
+{
+	for( int i = 0; i < d_heap.size(); i++ )
+	{
+		if( d_heap[i]->mayContain( target ) )
+			return true;
+	}
+	return false;
+}
+
+PositionCursor::PositionCursor(const IndexEngine * eng, const IndexEngine::PositionQuery & q, Cursor * sub):
+	d_eng(eng),d_query(q),d_sub(sub),d_rank(0)
+{
+	settle();
+}
+
+PositionCursor::~PositionCursor()
+{
+	delete d_sub;
+}
+
+void PositionCursor::settle()
+{
+	d_items.clear();
+	d_rank = 0;
+	while( !d_sub->atEnd() )
+	{
+		d_rank = d_eng->matchPositions( d_query, d_sub->doc(), &d_items );
+		if( d_rank != 0 )
+			return;
+		d_sub->next();
+	}
+}
+
+void PositionCursor::next()
+{
+	if( d_sub->atEnd() )
+		return;
+	d_sub->next();
+	settle();
+}
+
+void PositionCursor::advanceTo(Udb::OID target)
+{
+	if( d_sub->doc() >= target )
+		return;
+	d_sub->advanceTo( target );
+	settle();
+}
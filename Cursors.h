@@ -0,0 +1,230 @@
+#ifndef CURSORS_H
+#define CURSORS_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "Postings.h"
+#include "HitList.h"
+#include <Udb/Global.h>
+
+namespace Fts
+{
+	// Pull-Cursor ueber ein Suchresultat in OID-Reihenfolge; am Ende steht doc() auf endDoc().
+	// Ausgewertet wird erst beim Weiterschalten, der Speicherbedarf haengt nur von der Form der Abfrage ab.
+	class Cursor
+	{
+	public:
+		virtual ~Cursor() {}
+		static Udb::OID endDoc();
+		virtual bool atEnd() const { return doc() == endDoc(); }
+		virtual Udb::OID doc() const = 0;
+		virtual quint32 rank() const = 0;
+		virtual void next() = 0;
+		virtual void advanceTo( Udb::OID ) = 0; // erstes Doc >= OID
+		// false, wenn advanceTo sicher nicht auf dem Doc landet; schaltet nicht weiter und dekodiert nichts
+		virtual bool mayContain( Udb::OID ) const { return true; }
+	};
+
+	// Bewertung eines Terms pro Doc nach IndexEngine::getScoring, als Ganzzahl wie d_rank
+	class Scorer
+	{
+	public:
+		Scorer():d_bm25(false),d_idf(0),d_k1(0),d_b(0),d_avgLen(1) {}
+		Scorer( const IndexEngine*, quint32 tid );
+		bool usesLength() const { return d_bm25; }
+		quint32 score( quint32 tf, quint32 len ) const;
+		quint32 bound( quint32 tf ) const; // obere Schranke von score fuer beliebige Laengen
+	private:
+		bool d_bm25;
+		double d_idf, d_k1, d_b, d_avgLen;
+	};
+
+	// Laengen der Docs fuer BM25, in aufsteigender OID-Reihenfolge abgefragt. Bei vielen Docs im Verhaeltnis
+	// zu allen Docs laeuft ein Udb::Git ueber die Laengen mit, sonst wird jede Laenge einzeln gelesen.
+	// d_dbLock wird pro Aufruf einmal genommen, d_lock gar nicht.
+	class LengthReader
+	{
+	public:
+		LengthReader( const IndexEngine*, int docs ); // docs..erwartete Anzahl Abfragen
+		~LengthReader();
+		quint32 length( Udb::OID doc ); // doc nicht kleiner als beim letzten Aufruf
+		QVector<quint32> lengths( const QVector<Udb::OID>& docs ); // aufsteigend sortiert
+	private:
+		quint32 read( Udb::OID doc ); // unter d_dbLock
+		const IndexEngine* d_eng;
+		Udb::Git* d_git; // 0..einzeln lesen
+		bool d_more; // d_git steht auf einer Laenge
+	};
+
+	// Laeuft ueber die Postings eines Terms, im BlockFormat blockweise mit Sprung ueber das Verzeichnis.
+	// Im RowFormat oder fuer bereits berechnete Resultate gibt es nur einen Block mit der ganzen Liste.
+	// Am Ende steht doc() auf endDoc().
+	class TermCursor : public Cursor
+	{
+	public:
+		TermCursor( const IndexEngine*, quint32 tid );
+		TermCursor( const IndexEngine*, const HitList& scored ); // rank ist bereits die Bewertung
+		~TermCursor();
+
+		Udb::OID doc() const;
+		bool atEnd() const { return d_cur >= d_blocks.size(); }
+		quint32 rank() const { return score(); }
+		quint32 freq() const { return d_buf.rank( d_pos ); }
+		quint32 score() const;
+		void next();
+		void advanceTo( Udb::OID );
+		bool mayContain( Udb::OID ) const; // nur mit dem Verzeichnis
+
+		// Block-Max: verschiebt nur den Zeiger ins Verzeichnis, ohne Blocks zu dekodieren
+		void seekBlock( Udb::OID );
+		quint32 blockMax() const; // obere Schranke von score im Block von seekBlock
+		Udb::OID blockLast() const;
+		quint32 maxScore() const { return d_maxScore; } // obere Schranke ueber alle Docs
+
+		// Die k besten Docs (Bewertung, OID) nach Bewertung absteigend; Summe der Bewertungen aller
+		// Cursor. Block-Max-WAND nach Ding/Suel 2011: Bereiche, deren Schranken zusammen nicht ueber die
+		// k-beste Bewertung kommen, werden ohne Dekodieren uebersprungen. Die Cursor werden verbraucht.
+		typedef QPair<quint32,Udb::OID> Hit;
+		static QList<Hit> topK( const QList<TermCursor*>&, int k );
+	private:
+		void load( int block );
+		const IndexEngine* d_eng;
+		quint32 d_tid;
+		Scorer d_scorer;
+		PostingCodec::BlockDir d_blocks;
+		HitList d_buf; // Docs des Blocks d_cur
+		int d_cur;
+		int d_pos;
+		int d_shallow; // Block von seekBlock
+		quint32 d_maxScore;
+		bool d_scored;
+		LengthReader* d_lengths; // nur mit BM25
+	};
+
+	// RowFormat: laeuft mit Udb::Git direkt ueber die Zellen eines Terms, ohne die Liste zu dekodieren.
+	// advanceTo schaltet sequenziell weiter, da die Zellen kein Verzeichnis haben.
+	class PostingCursor : public Cursor
+	{
+	public:
+		PostingCursor( const IndexEngine*, quint32 tid );
+		~PostingCursor();
+		Udb::OID doc() const { return d_doc; }
+		quint32 rank() const;
+		void next();
+		void advanceTo( Udb::OID );
+	private:
+		void fetch();
+		const IndexEngine* d_eng;
+		quint32 d_tid;
+		Scorer d_scorer;
+		Udb::Git* d_git; // wird nur unter IndexEngine::d_dbLock verwendet
+		bool d_more; // d_git steht auf einer Zelle des Terms
+		Udb::OID d_doc;
+		quint32 d_freq;
+		LengthReader* d_lengths; // nur mit BM25
+	};
+
+	// Docs, die in allen Cursorn vorkommen; rank ist die Summe. Die Cursor sollten nach aufsteigender
+	// Laenge geordnet sein, da der erste die Kandidaten vorgibt. Uebernimmt die Cursor.
+	class AndCursor : public Cursor
+	{
+	public:
+		AndCursor( const QList<Cursor*>& );
+		~AndCursor();
+		Udb::OID doc() const { return d_doc; }
+		quint32 rank() const { return d_rank; }
+		void next();
+		void advanceTo( Udb::OID );
+		bool mayContain( Udb::OID ) const;
+	private:
+		void align( Udb::OID );
+		QList<Cursor*> d_subs;
+		Udb::OID d_doc;
+		quint32 d_rank;
+	};
+
+	// Docs, die in mindestens einem Cursor vorkommen; rank ist die Summe ueber die Cursor auf dem Doc.
+	// Die Cursor liegen in einem Min-Heap nach doc(). Uebernimmt die Cursor.
+	class OrCursor : public Cursor
+	{
+	public:
+		OrCursor( const QList<Cursor*>& );
+		~OrCursor();
+		Udb::OID doc() const { return d_doc; }
+		quint32 rank() const { return d_rank; }
+		void next();
+		void advanceTo( Udb::OID );
+		bool mayContain( Udb::OID ) const;
+	private:
+		void siftDown( int );
+		void removeTop();
+		void settle();
+		quint32 rankAt( int ) const;
+		QVector<Cursor*> d_heap; // ohne beendete Cursor
+		QList<Cursor*> d_subs;
+		Udb::OID d_doc;
+		quint32 d_rank;
+	};
+
+	// Docs des ersten Cursors, die im zweiten nicht vorkommen; rank ist der des ersten. Fuer jeden Kandidaten
+	// wird zuerst mayContain des zweiten gefragt; advanceTo und damit das Dekodieren eines Blocks braucht es
+	// nur, wenn das Doc im Bereich eines Blocks liegt. Die ausgeschlossene Liste wird nie ganz gelesen.
+	// Uebernimmt die Cursor.
+	class AndNotCursor : public Cursor
+	{
+	public:
+		AndNotCursor( Cursor* include, Cursor* exclude );
+		~AndNotCursor();
+		Udb::OID doc() const { return d_inc->doc(); }
+		quint32 rank() const { return d_inc->rank(); }
+		void next();
+		void advanceTo( Udb::OID );
+		bool mayContain( Udb::OID doc ) const { return d_inc->mayContain( doc ); }
+	private:
+		void settle();
+		Cursor* d_inc;
+		Cursor* d_exc;
+	};
+
+	// Docs des Cursors, in denen die Positionen der Terme passen (siehe IndexEngine::findPhrase); rank ist die
+	// Anzahl Treffer. Die Positionen werden nur fuer die Docs gelesen, auf denen der Cursor steht.
+	// Uebernimmt den Cursor.
+	class PositionCursor : public Cursor
+	{
+	public:
+		PositionCursor( const IndexEngine*, const IndexEngine::PositionQuery&, Cursor* );
+		~PositionCursor();
+		Udb::OID doc() const { return d_sub->doc(); }
+		quint32 rank() const { return d_rank; }
+		const IndexEngine::ItemHits& items() const { return d_items; } // Treffer pro Item ausser dem Doc selber
+		void next();
+		void advanceTo( Udb::OID );
+		bool mayContain( Udb::OID doc ) const { return d_sub->mayContain( doc ); }
+	private:
+		void settle();
+		const IndexEngine* d_eng;
+		IndexEngine::PositionQuery d_query;
+		Cursor* d_sub;
+		quint32 d_rank;
+		IndexEngine::ItemHits d_items;
+	};
+}
+
+#endif // CURSORS_H
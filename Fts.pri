@@ -3,12 +3,28 @@ SOURCES += \
     ../Fts/Stopper.cpp \
     ../Fts/Stemmer.cpp \
     ../Fts/LibStemmerUtils.cpp \
-    ../Fts/IndexEngine.cpp
+    ../Fts/IndexEngine.cpp \
+    ../Fts/Postings.cpp \
+    ../Fts/SetKernels.cpp \
+    ../Fts/HitList.cpp \
+    ../Fts/Cursors.cpp \
+    ../Fts/Automaton.cpp \
+    ../Fts/TermFile.cpp \
+    ../Fts/PostingCache.cpp \
+    ../Fts/Query.cpp
 
 HEADERS += \
     ../Fts/Tokenizer.h \
     ../Fts/Stopper.h \
     ../Fts/Stemmer.h \
     ../Fts/LibStemmer.h \
-    ../Fts/IndexEngine.h
+    ../Fts/IndexEngine.h \
+    ../Fts/Postings.h \
+    ../Fts/SetKernels.h \
+    ../Fts/HitList.h \
+    ../Fts/Cursors.h \
+    ../Fts/Automaton.h \
+    ../Fts/TermFile.h \
+    ../Fts/PostingCache.h \
+    ../Fts/Query.h
 
@@ -0,0 +1,449 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "HitList.h"
+#include "SetKernels.h"
+#include <string.h>
+using namespace Fts;
+
+HitList::HitList(const IndexEngine::DocHits & l)
+{
+	int items = 0;
+	for( int i = 0; i < l.size(); i++ )
+		items += l[i].d_items.size();
+	reserve( l.size(), items );
+	for( int i = 0; i < l.size(); i++ )
+	{
+		appendDoc( l[i].d_doc, l[i].d_rank );
+		for( int k = 0; k < l[i].d_items.size(); k++ )
+			appendItem( l[i].d_items[k].d_item, l[i].d_items[k].d_rank );
+	}
+}
+
+IndexEngine::DocHits HitList::toDocHits() const
+{
+	IndexEngine::DocHits res;
+	res.reserve( size() );
+	for( int i = 0; i < size(); i++ )
+	{
+		IndexEngine::DocHit hit;
+		hit.d_doc = d_docs[i];
+		hit.d_rank = d_ranks[i];
+		const int end = d_itemEnd[i];
+		for( int k = itemBegin( i ); k < end; k++ )
+		{
+			IndexEngine::ItemHit h;
+			h.d_item = d_items[k];
+			h.d_rank = d_itemRanks[k];
+			hit.d_items.append( h );
+		}
+		res.append( hit );
+	}
+	return res;
+}
+
+void HitList::appendDoc(Udb::OID doc, quint32 rank)
+{
+	Q_ASSERT( d_docs.isEmpty() || d_docs.last() < doc );
+	d_docs.append( doc );
+	d_ranks.append( rank );
+	d_itemEnd.append( d_items.size() );
+}
+
+void HitList::appendItem(Udb::OID item, quint32 rank)
+{
+	Q_ASSERT( !d_itemEnd.isEmpty() );
+	Q_ASSERT( d_itemEnd.last() == itemBegin( size() - 1 ) || d_items.last() < item );
+	d_items.append( item );
+	d_itemRanks.append( rank );
+	d_itemEnd.last() = d_items.size();
+}
+
+void HitList::reserve(int docs, int items)
+{
+	d_docs.reserve( docs );
+	d_ranks.reserve( docs );
+	d_itemEnd.reserve( docs );
+	d_items.reserve( items );
+	d_itemRanks.reserve( items );
+}
+
+void HitList::clear()
+{
+	d_docs.clear();
+	d_ranks.clear();
+	d_itemEnd.clear();
+	d_items.clear();
+	d_itemRanks.clear();
+}
+
+void HitList::swap(HitList & o)
+{
+	d_docs.swap( o.d_docs );
+	d_ranks.swap( o.d_ranks );
+	d_itemEnd.swap( o.d_itemEnd );
+	d_items.swap( o.d_items );
+	d_itemRanks.swap( o.d_itemRanks );
+}
+
+static int _gallop( const Udb::OID* l, int n, int from, Udb::OID oid )
+{
+	int lo = from, hi = from, step = 1;
+	while( hi < n && l[hi] < oid )
+	{
+		lo = hi + 1;
+		hi += step;
+		step *= 2;
+	}
+	if( hi > n )
+		hi = n;
+	while( lo < hi )
+	{
+		const int mid = lo + ( hi - lo ) / 2;
+		if( l[mid] < oid )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Positionspaare der gemeinsamen Docs; bei stark ungleichen Groessen galoppierend, sonst mit SetKernels
+static int _matchDocs( const QVector<Udb::OID>& a, const QVector<Udb::OID>& b, QVector<int>& ia, QVector<int>& ib )
+{
+	const int na = a.size();
+	const int nb = b.size();
+	ia.resize( qMin( na, nb ) );
+	ib.resize( ia.size() );
+	if( na / HitList::GallopRatio <= nb && nb / HitList::GallopRatio <= na )
+		return SetKernels::intersect( a.constData(), na, b.constData(), nb, ia.data(), ib.data() );
+	const bool aSmall = na < nb;
+	const Udb::OID* s = ( aSmall ) ? a.constData() : b.constData();
+	const Udb::OID* l = ( aSmall ) ? b.constData() : a.constData();
+	const int ns = qMin( na, nb );
+	const int nl = qMax( na, nb );
+	int* is = ( aSmall ) ? ia.data() : ib.data();
+	int* il = ( aSmall ) ? ib.data() : ia.data();
+	int n = 0, j = 0;
+	for( int i = 0; i < ns && j < nl; i++ )
+	{
+		j = _gallop( l, nl, j, s[i] );
+		if( j < nl && l[j] == s[i] )
+		{
+			is[n] = i;
+			il[n] = j;
+			n++;
+			j++;
+		}
+	}
+	return n;
+}
+
+// Die Items eines Docs werden direkt in das flache Array des Resultats geschrieben
+struct _ItemSink
+{
+	Udb::OID* d_items;
+	quint32* d_ranks;
+	int d_at;
+	void copy( const HitList& l, const QVector<Udb::OID>& items, const QVector<quint32>& ranks, int i )
+	{
+		const int from = l.itemBegin( i );
+		const int n = l.itemEnd( i ) - from;
+		if( n == 0 )
+			return;
+		::memcpy( d_items + d_at, items.constData() + from, n * sizeof(Udb::OID) );
+		::memcpy( d_ranks + d_at, ranks.constData() + from, n * sizeof(quint32) );
+		d_at += n;
+	}
+	void join( const QVector<Udb::OID>& li, const QVector<quint32>& lr, int la, int ln,
+			   const QVector<Udb::OID>& ri, const QVector<quint32>& rr, int ra, int rn, bool uniteItems )
+	{
+		if( uniteItems )
+			d_at += SetKernels::unite( li.constData() + la, lr.constData() + la, ln,
+									   ri.constData() + ra, rr.constData() + ra, rn, d_items + d_at, d_ranks + d_at );
+		else
+			d_at += SetKernels::intersect( li.constData() + la, lr.constData() + la, ln,
+										   ri.constData() + ra, rr.constData() + ra, rn, d_items + d_at, d_ranks + d_at );
+	}
+};
+
+HitList HitList::intersect(const HitList & lhs, const HitList & rhs, bool uniteItems)
+{
+	HitList res;
+	if( lhs.isEmpty() || rhs.isEmpty() )
+		return res;
+	QVector<int> ia, ib;
+	const int n = _matchDocs( lhs.d_docs, rhs.d_docs, ia, ib );
+
+	// Zuerst die Obergrenze der Items, damit waehrend des Merge nichts mehr alloziert wird
+	int maxItems = 0;
+	for( int k = 0; k < n; k++ )
+	{
+		const int ln = lhs.itemEnd( ia[k] ) - lhs.itemBegin( ia[k] );
+		const int rn = rhs.itemEnd( ib[k] ) - rhs.itemBegin( ib[k] );
+		maxItems += ( uniteItems ) ? ln + rn : qMin( ln, rn );
+	}
+	res.d_docs.resize( n );
+	res.d_ranks.resize( n );
+	res.d_itemEnd.resize( n );
+	res.d_items.resize( maxItems );
+	res.d_itemRanks.resize( maxItems );
+	_ItemSink sink;
+	sink.d_items = res.d_items.data();
+	sink.d_ranks = res.d_itemRanks.data();
+	sink.d_at = 0;
+	for( int k = 0; k < n; k++ )
+	{
+		const int i = ia[k];
+		const int j = ib[k];
+		res.d_docs[k] = lhs.d_docs[i];
+		res.d_ranks[k] = lhs.d_ranks[i] + rhs.d_ranks[j]; // RISK
+		const int la = lhs.itemBegin( i );
+		const int ra = rhs.itemBegin( j );
+		sink.join( lhs.d_items, lhs.d_itemRanks, la, lhs.itemEnd( i ) - la,
+				   rhs.d_items, rhs.d_itemRanks, ra, rhs.itemEnd( j ) - ra, uniteItems );
+		res.d_itemEnd[k] = sink.d_at;
+	}
+	res.d_items.resize( sink.d_at );
+	res.d_itemRanks.resize( sink.d_at );
+	return res;
+}
+
+HitList HitList::subtract(const HitList & lhs, const HitList & rhs, bool subtractItems)
+{
+	if( lhs.isEmpty() || rhs.isEmpty() )
+		return lhs;
+	QVector<int> ia, ib;
+	const int n = _matchDocs( lhs.d_docs, rhs.d_docs, ia, ib );
+	if( n == 0 )
+		return lhs;
+	HitList res;
+	res.reserve( lhs.size(), lhs.itemCount() );
+	int k = 0;
+	for( int i = 0; i < lhs.size(); i++ )
+	{
+		const int from = lhs.itemBegin( i );
+		const int to = lhs.itemEnd( i );
+		if( k < n && ia[k] == i )
+		{
+			const int j = ib[k++];
+			if( !subtractItems || rhs.itemBegin( j ) == rhs.itemEnd( j ) )
+				continue;
+			if( from != to )
+			{
+				// nur die Items, die rhs nicht hat; ohne solche faellt das Doc weg
+				int b = rhs.itemBegin( j );
+				const int end = rhs.itemEnd( j );
+				bool found = false;
+				for( int a = from; a < to; a++ )
+				{
+					while( b < end && rhs.d_items[b] < lhs.d_items[a] )
+						b++;
+					if( b < end && rhs.d_items[b] == lhs.d_items[a] )
+						continue;
+					if( !found )
+						res.appendDoc( lhs.d_docs[i], lhs.d_ranks[i] );
+					found = true;
+					res.appendItem( lhs.d_items[a], lhs.d_itemRanks[a] );
+				}
+				continue;
+			}
+		}
+		res.appendDoc( lhs.d_docs[i], lhs.d_ranks[i] );
+		for( int a = from; a < to; a++ )
+			res.appendItem( lhs.d_items[a], lhs.d_itemRanks[a] );
+	}
+	return res;
+}
+
+HitList HitList::unite(const HitList & lhs, const HitList & rhs, bool uniteItems)
+{
+	if( lhs.isEmpty() )
+		return rhs;
+	if( rhs.isEmpty() )
+		return lhs;
+	QVector<int> ia( lhs.size() + rhs.size() );
+	QVector<int> ib( ia.size() );
+	const int n = SetKernels::unite( lhs.d_docs.constData(), lhs.size(), rhs.d_docs.constData(), rhs.size(),
+									 ia.data(), ib.data() );
+	int maxItems = 0;
+	for( int k = 0; k < n; k++ )
+	{
+		const int ln = ( ia[k] < 0 ) ? 0 : lhs.itemEnd( ia[k] ) - lhs.itemBegin( ia[k] );
+		const int rn = ( ib[k] < 0 ) ? 0 : rhs.itemEnd( ib[k] ) - rhs.itemBegin( ib[k] );
+		if( ia[k] < 0 || ib[k] < 0 || uniteItems )
+			maxItems += ln + rn;
+		else
+			maxItems += qMin( ln, rn );
+	}
+	HitList res;
+	res.d_docs.resize( n );
+	res.d_ranks.resize( n );
+	res.d_itemEnd.resize( n );
+	res.d_items.resize( maxItems );
+	res.d_itemRanks.resize( maxItems );
+	_ItemSink sink;
+	sink.d_items = res.d_items.data();
+	sink.d_ranks = res.d_itemRanks.data();
+	sink.d_at = 0;
+	for( int k = 0; k < n; k++ )
+	{
+		const int i = ia[k];
+		const int j = ib[k];
+		if( j < 0 )
+		{
+			res.d_docs[k] = lhs.d_docs[i];
+			res.d_ranks[k] = lhs.d_ranks[i];
+			sink.copy( lhs, lhs.d_items, lhs.d_itemRanks, i );
+		}else if( i < 0 )
+		{
+			res.d_docs[k] = rhs.d_docs[j];
+			res.d_ranks[k] = rhs.d_ranks[j];
+			sink.copy( rhs, rhs.d_items, rhs.d_itemRanks, j );
+		}else
+		{
+			res.d_docs[k] = lhs.d_docs[i];
+			res.d_ranks[k] = lhs.d_ranks[i] + rhs.d_ranks[j]; // RISK
+			const int la = lhs.itemBegin( i );
+			const int ra = rhs.itemBegin( j );
+			sink.join( lhs.d_items, lhs.d_itemRanks, la, lhs.itemEnd( i ) - la,
+					   rhs.d_items, rhs.d_itemRanks, ra, rhs.itemEnd( j ) - ra, uniteItems );
+		}
+		res.d_itemEnd[k] = sink.d_at;
+	}
+	res.d_items.resize( sink.d_at );
+	res.d_itemRanks.resize( sink.d_at );
+	return res;
+}
+
+struct _Head
+{
+	Udb::OID d_doc;
+	int d_list;
+	int d_pos;
+	bool operator<( const _Head& rhs ) const
+	{
+		return d_doc < rhs.d_doc || ( d_doc == rhs.d_doc && d_list < rhs.d_list );
+	}
+};
+
+static void _siftDown( QVector<_Head>& heap, int i )
+{
+	const int n = heap.size();
+	const _Head h = heap[i];
+	while( true )
+	{
+		int c = 2 * i + 1;
+		if( c >= n )
+			break;
+		if( c + 1 < n && heap[c + 1] < heap[c] )
+			c++;
+		if( !( heap[c] < h ) )
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = h;
+}
+
+HitList HitList::unite(const QList<HitList> & lists, bool uniteItems)
+{
+	QVector<_Head> heap;
+	heap.reserve( lists.size() );
+	int maxDocs = 0;
+	for( int l = 0; l < lists.size(); l++ )
+	{
+		if( lists[l].isEmpty() )
+			continue;
+		_Head h;
+		h.d_doc = lists[l].d_docs.first();
+		h.d_list = l;
+		h.d_pos = 0;
+		heap.append( h );
+		maxDocs = qMax( maxDocs, lists[l].size() );
+	}
+	if( heap.isEmpty() )
+		return HitList();
+	if( heap.size() == 1 )
+		return lists[heap.first().d_list];
+	for( int i = heap.size() / 2 - 1; i >= 0; i-- )
+		_siftDown( heap, i );
+
+	HitList res;
+	res.reserve( maxDocs, 0 );
+	QVector<Udb::OID> items, tmpItems;
+	QVector<quint32> ranks, tmpRanks;
+	while( !heap.isEmpty() )
+	{
+		// Alle Listen mit dem kleinsten Doc abholen; deren Items werden nacheinander verknuepft
+		const Udb::OID doc = heap.first().d_doc;
+		quint32 rank = 0;
+		int contributors = 0;
+		while( !heap.isEmpty() && heap.first().d_doc == doc )
+		{
+			_Head& h = heap.first();
+			const HitList& l = lists[h.d_list];
+			rank += l.d_ranks[h.d_pos]; // RISK
+			const int from = l.itemBegin( h.d_pos );
+			const int n = l.itemEnd( h.d_pos ) - from;
+			if( contributors == 0 )
+			{
+				items.resize( n );
+				ranks.resize( n );
+				if( n > 0 )
+				{
+					::memcpy( items.data(), l.d_items.constData() + from, n * sizeof(Udb::OID) );
+					::memcpy( ranks.data(), l.d_itemRanks.constData() + from, n * sizeof(quint32) );
+				}
+			}else
+			{
+				tmpItems.resize( items.size() + n );
+				tmpRanks.resize( tmpItems.size() );
+				int m;
+				if( uniteItems )
+					m = SetKernels::unite( items.constData(), ranks.constData(), items.size(),
+										   l.d_items.constData() + from, l.d_itemRanks.constData() + from, n,
+										   tmpItems.data(), tmpRanks.data() );
+				else
+					m = SetKernels::intersect( items.constData(), ranks.constData(), items.size(),
+											   l.d_items.constData() + from, l.d_itemRanks.constData() + from, n,
+											   tmpItems.data(), tmpRanks.data() );
+				tmpItems.resize( m );
+				tmpRanks.resize( m );
+				items.swap( tmpItems );
+				ranks.swap( tmpRanks );
+			}
+			contributors++;
+			h.d_pos++;
+			if( h.d_pos < l.size() )
+				h.d_doc = l.d_docs[h.d_pos];
+			else
+			{
+				heap.first() = heap.last();
+				heap.pop_back();
+			}
+			if( !heap.isEmpty() )
+				_siftDown( heap, 0 );
+		}
+		res.appendDoc( doc, rank );
+		for( int k = 0; k < items.size(); k++ )
+			res.appendItem( items[k], ranks[k] );
+	}
+	return res;
+}
@@ -0,0 +1,76 @@
+#ifndef HITLIST_H
+#define HITLIST_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "IndexEngine.h"
+#include <QVector>
+#include <QList>
+
+namespace Fts
+{
+	// Suchresultat als struct-of-arrays: Docs und Raenge in je einem Array, die ItemHits aller Docs
+	// hintereinander in einem flachen Array; Doc i besitzt die Items itemBegin(i)..itemEnd(i)-1.
+	// Gleiche Semantik wie DocHits (eindeutige OIDs, aufsteigend sortiert), aber ohne Allokation pro Hit.
+	// Kopien sind implizit geteilt, Rueckgabewerte werden verschoben.
+	class HitList
+	{
+	public:
+		enum { GallopRatio = 16 }; // ab diesem Groessenverhaeltnis galoppiert intersect, siehe IndexEngine::benchmarkIntersect
+		HitList() {}
+		explicit HitList( const IndexEngine::DocHits& );
+		IndexEngine::DocHits toDocHits() const;
+
+		int size() const { return d_docs.size(); }
+		bool isEmpty() const { return d_docs.isEmpty(); }
+		Udb::OID doc( int i ) const { return d_docs[i]; }
+		quint32 rank( int i ) const { return d_ranks[i]; }
+		void setRank( int i, quint32 r ) { d_ranks[i] = r; }
+		int itemBegin( int i ) const { return ( i == 0 ) ? 0 : d_itemEnd[i-1]; }
+		int itemEnd( int i ) const { return d_itemEnd[i]; }
+		Udb::OID item( int k ) const { return d_items[k]; }
+		quint32 itemRank( int k ) const { return d_itemRanks[k]; }
+		int itemCount() const { return d_items.size(); }
+		const QVector<Udb::OID>& docs() const { return d_docs; }
+		const QVector<quint32>& ranks() const { return d_ranks; }
+
+		// Aufbau in OID-Reihenfolge; appendItem gehoert immer zum zuletzt angefuegten Doc
+		void appendDoc( Udb::OID doc, quint32 rank );
+		void appendItem( Udb::OID item, quint32 rank );
+		void reserve( int docs, int items );
+		void clear();
+		void swap( HitList& );
+
+		static HitList intersect( const HitList& lhs, const HitList& rhs, bool uniteItems );
+		static HitList unite( const HitList& lhs, const HitList& rhs, bool uniteItems );
+		static HitList subtract( const HitList& lhs, const HitList& rhs, bool subtractItems ); // wie IndexEngine::subtract
+		// k-Weg-Merge aller Listen in einem Durchgang ueber einen Min-Heap; ersetzt wiederholtes unite.
+		// Ohne uniteItems bleiben bei gemeinsamen Docs nur die Items, die in allen beteiligten Listen vorkommen.
+		static HitList unite( const QList<HitList>&, bool uniteItems );
+	private:
+		QVector<Udb::OID> d_docs;
+		QVector<quint32> d_ranks;
+		QVector<int> d_itemEnd; // pro Doc das Ende seiner Items in d_items
+		QVector<Udb::OID> d_items;
+		QVector<quint32> d_itemRanks;
+	};
+}
+
+#endif // HITLIST_H
@@ -21,6 +21,14 @@
 #include "Tokenizer.h"
 #include "Stemmer.h"
 #include "Stopper.h"
+#include "Postings.h"
+#include "SetKernels.h"
+#include "HitList.h"
+#include "Cursors.h"
+#include "Automaton.h"
+#include "TermFile.h"
+#include "PostingCache.h"
+#include "Query.h"
 #include <Udb/Transaction.h>
 #include <Udb/Idx.h>
 #include <Udb/Global.h>
@@ -28,11 +36,37 @@
 #include <QLocale> // wegen Test
 #include <QtDebug>
 #include <QBuffer>
+#include <QVector>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <string.h>
 #include <limits>
+#include <algorithm>
+#include <math.h>
 using namespace Fts;
 
 static const char s_rev = 0x07; // BEL
+static const QChar s_triBegin( 0x02 ); // Raender der Terme fuer die Trigramme, damit auch verankerte Muster
+static const QChar s_triEnd( 0x03 );   // ein Trigramm ergeben
+static const quint32 s_pendingOverhead = 64; // QHash-Node und QByteArray-Header pro Bulk-Eintrag
+static const quint32 s_termOverhead = 48; // QHash-Node und QString-Header pro Cache-Eintrag
+static const quint32 s_termIdRange = 256; // so viele Term-IDs werden auf einmal in AttrMaxTerm reserviert
+static const int s_drainBatch = 256; // Queue-Eintraege pro Portion im asynchronen Modus
+static const int s_drainSlice = 20; // ms pro Aufruf von onDrain
+static const int s_kernelMin = 64; // ab dieser Listenlaenge lohnt sich das Umkopieren der OIDs fuer SetKernels,
+static const int s_kernelRatio = 2; // aber nur bis zu diesem Groessenverhaeltnis, siehe benchmarkIntersect
+static const quint32 s_lengthTerm = 0; // unter dieser Term-ID stehen die Laengen der Docs, siehe getDocLength
+static const double s_scoreScale = 1000.0; // BM25 als Ganzzahl in d_rank
+static const int s_maxRanges = 64; // so viele Teilbereiche liest automatonIds hoechstens einzeln
+static const int s_expansionCacheSize = 16; // so viele Praefix-Expansionen werden zwischengespeichert
+static const quint32 s_unknownDf = 0xffffffff; // ExpandedTerm::d_df noch nicht gelesen
+static const int s_seekSteps = 8; // so weit geht _DictScan::skipTo schrittweise, bevor es neu aufsetzt
+static const int s_seekProbes = 32; // so viele findCells versucht skipTo hoechstens
 static QHash<Udb::Transaction*,IndexEngine*> s_cache;
+static QMutex s_cacheLock; // getIndex wird auch aus den Abfrage-Threads aufgerufen
 
 static QString _reverse( const QString& in)
 {
@@ -43,6 +77,42 @@ static QString _reverse( const QString& in)
 	return out;
 }
 
+static QStringList _trigrams( const QString& run )
+{
+	QStringList res;
+	for( int i = 0; i + 3 <= run.size(); i++ )
+		res.append( run.mid( i, 3 ) );
+	return res;
+}
+
+static QSet<QString> _patternTrigrams( const QString& pat )
+{
+	// Trigramme der Literale zwischen den Jokern; die Raender zaehlen mit, wenn dort kein Joker steht
+	QSet<QString> tris;
+	const QString padded = s_triBegin + pat + s_triEnd;
+	QString run;
+	for( int i = 0; i <= padded.size(); i++ )
+	{
+		if( i == padded.size() || padded[i] == QChar('*') || padded[i] == QChar('?') )
+		{
+			foreach( const QString& tri, _trigrams( run ) )
+				tris.insert( tri );
+			run.clear();
+		}else
+			run += padded[i];
+	}
+	return tris;
+}
+
+static QByteArray writeTriKey( const QString& tri, const QByteArray& term )
+{
+	// Trigramm UTF-8, 0, Term UTF-8; das Trigramm allein ist der Schluessel der Anzahl Terme
+	QByteArray key = tri.toUtf8();
+	key.append( char(0) );
+	key.append( term );
+	return key;
+}
+
 static QByteArray writeKey2( quint32 nr, Udb::OID oid )
 {
 	QBuffer buf;
@@ -79,6 +149,86 @@ static int readKey3( const QByteArray& in, quint32& nr, Udb::OID& doc, Udb::OID&
 	return n;
 }
 
+static QByteArray writePosKey( quint32 nr, Udb::OID doc, Udb::OID item, Udb::Atom attr )
+{
+	QBuffer buf;
+	buf.open( QIODevice::WriteOnly );
+	Stream::Helper::writeMultibyte32( &buf, nr );
+	Stream::Helper::writeMultibyte64( &buf, doc );
+	Stream::Helper::writeMultibyte64( &buf, item );
+	Stream::Helper::writeMultibyte32( &buf, attr );
+	buf.close();
+	return buf.buffer();
+}
+
+static void readPosKey( const QByteArray& in, Udb::OID& item, Udb::Atom& attr )
+{
+	QBuffer buf;
+	buf.buffer() = in;
+	buf.open( QIODevice::ReadOnly );
+	quint32 nr;
+	Udb::OID doc;
+	Stream::Helper::readMultibyte32( &buf, nr );
+	Stream::Helper::readMultibyte64( &buf, doc );
+	Stream::Helper::readMultibyte64( &buf, item );
+	Stream::Helper::readMultibyte32( &buf, attr );
+}
+
+static QByteArray writePosList( const QList<quint32>& pos ) // aufsteigend, als Differenzen
+{
+	QBuffer buf;
+	buf.open( QIODevice::WriteOnly );
+	quint32 last = 0;
+	for( int i = 0; i < pos.size(); i++ )
+	{
+		Stream::Helper::writeMultibyte32( &buf, pos[i] - last );
+		last = pos[i];
+	}
+	buf.close();
+	return buf.buffer();
+}
+
+static void readPosList( const QByteArray& in, QVector<quint32>& out )
+{
+	QBuffer buf;
+	buf.buffer() = in;
+	buf.open( QIODevice::ReadOnly );
+	quint32 last = 0, d;
+	while( Stream::Helper::readMultibyte32( &buf, d ) > 0 )
+	{
+		last += d;
+		out.append( last );
+	}
+}
+
+static QByteArray writeQueueKey( Udb::OID oid, Udb::Atom attr )
+{
+	QBuffer buf;
+	buf.open( QIODevice::WriteOnly );
+	Stream::Helper::writeMultibyte64( &buf, oid );
+	Stream::Helper::writeMultibyte32( &buf, attr );
+	buf.close();
+	return buf.buffer();
+}
+
+static void readQueueKey( const QByteArray& in, Udb::OID& oid, Udb::Atom& attr )
+{
+	QBuffer buf;
+	buf.buffer() = in;
+	buf.open( QIODevice::ReadOnly );
+	Stream::Helper::readMultibyte64( &buf, oid );
+	Stream::Helper::readMultibyte32( &buf, attr );
+}
+
+static QString readQueueText( const QByteArray& in, quint32& ticket )
+{
+	QBuffer buf;
+	buf.buffer() = in;
+	buf.open( QIODevice::ReadOnly );
+	Stream::Helper::readMultibyte32( &buf, ticket );
+	return QString::fromUtf8( in.mid( buf.pos() ) );
+}
+
 static QByteArray writeFreq( quint32 f )
 {
 	QBuffer buf;
@@ -95,18 +245,326 @@ static quint32 readFreq( const QByteArray& in )
 	return f;
 }
 
+static QByteArray writeStats( quint32 df, quint64 ttf )
+{
+	QBuffer buf;
+	buf.open( QIODevice::WriteOnly );
+	Stream::Helper::writeMultibyte32( &buf, df );
+	Stream::Helper::writeMultibyte64( &buf, ttf );
+	buf.close();
+	return buf.buffer();
+}
+
+static IndexEngine::TermStats readStats( const QByteArray& in )
+{
+	IndexEngine::TermStats s;
+	QBuffer buf;
+	buf.buffer() = in;
+	buf.open( QIODevice::ReadOnly );
+	Stream::Helper::readMultibyte32( &buf, s.d_df );
+	Stream::Helper::readMultibyte64( &buf, s.d_ttf );
+	return s;
+}
+
+namespace Fts
+{
+	// Beschraenkte Warteschlange zwischen Leser, Analyse-Threads und Schreiber von reindexAll
+	template<class T>
+	class _Queue
+	{
+	public:
+		_Queue( int cap ):d_cap(cap),d_closed(false) {}
+		bool tryPush( const T& t )
+		{
+			QMutexLocker lock( &d_lock );
+			if( d_q.size() >= d_cap )
+				return false;
+			d_q.append( t );
+			d_notEmpty.wakeOne();
+			return true;
+		}
+		void push( const T& t )
+		{
+			QMutexLocker lock( &d_lock );
+			while( d_q.size() >= d_cap )
+				d_notFull.wait( &d_lock );
+			d_q.append( t );
+			d_notEmpty.wakeOne();
+		}
+		bool pop( T& t ) // false..geschlossen und leer
+		{
+			QMutexLocker lock( &d_lock );
+			while( d_q.isEmpty() && !d_closed )
+				d_notEmpty.wait( &d_lock );
+			if( d_q.isEmpty() )
+				return false;
+			t = d_q.takeFirst();
+			d_notFull.wakeOne();
+			return true;
+		}
+		void close()
+		{
+			QMutexLocker lock( &d_lock );
+			d_closed = true;
+			d_notEmpty.wakeAll();
+		}
+	private:
+		QList<T> d_q;
+		QMutex d_lock;
+		QWaitCondition d_notEmpty, d_notFull;
+		int d_cap;
+		bool d_closed;
+	};
+
+	struct _Job
+	{
+		int d_seq;
+		QStringList d_old, d_new;
+		QList<Udb::Atom> d_attrs; // nur mit Positionen, gleich lang wie d_new
+	};
+
+	struct _Result
+	{
+		int d_seq;
+		IndexEngine::Terms d_terms;
+		QList<Udb::Atom> d_attrs;
+		QList<IndexEngine::Positions> d_oldPos, d_newPos; // pro d_attrs
+		void analyze( const _Job& job, Tokenizer* tok, Stemmer* ste, Stopper* sto, bool keepRaw )
+		{
+			d_seq = job.d_seq;
+			foreach( const QString& s, job.d_old )
+				IndexEngine::analyze( s, -1, d_terms, tok, ste, sto, false );
+			foreach( const QString& s, job.d_new )
+				IndexEngine::analyze( s, 1, d_terms, tok, ste, sto, keepRaw );
+			d_attrs = job.d_attrs;
+			for( int i = 0; i < job.d_attrs.size(); i++ )
+			{
+				d_oldPos.append( IndexEngine::Positions() );
+				d_newPos.append( IndexEngine::Positions() );
+				if( i < job.d_old.size() )
+					IndexEngine::analyzePositions( job.d_old[i], d_oldPos.last(), tok, ste, sto );
+				IndexEngine::analyzePositions( job.d_new[i], d_newPos.last(), tok, ste, sto );
+			}
+		}
+	};
+
+	class _Analyzer : public QThread
+	{
+	public:
+		_Analyzer( _Queue<_Job>* in, _Queue<_Result>* out, Tokenizer* tok, Stemmer* ste, Stopper* sto, bool keepRaw ):
+			d_in(in),d_out(out),d_tok(tok),d_ste(ste),d_sto(sto),d_keepRaw(keepRaw) {}
+		~_Analyzer()
+		{
+			delete d_tok;
+			delete d_ste;
+			delete d_sto;
+		}
+		void run()
+		{
+			_Job job;
+			while( d_in->pop( job ) )
+			{
+				_Result res;
+				res.analyze( job, d_tok, d_ste, d_sto, d_keepRaw );
+				d_out->push( res );
+			}
+		}
+	private:
+		_Queue<_Job>* d_in;
+		_Queue<_Result>* d_out;
+		Tokenizer* d_tok;
+		Stemmer* d_ste;
+		Stopper* d_sto;
+		bool d_keepRaw;
+	};
+
+	static QByteArray _prefixEnd( QByteArray p ) // kleinster Schluessel nach allen mit dem Anfang p; leer..keiner
+	{
+		while( !p.isEmpty() && quint8( p[p.size()-1] ) == 0xff )
+			p.chop( 1 );
+		if( !p.isEmpty() )
+			p[p.size()-1] = char( quint8( p[p.size()-1] ) + 1 );
+		return p;
+	}
+
+	// Schluessel des Dictionary unter prefix in Reihenfolge; mit TermFile aus der Datei und dem Delta
+	// zusammengefuehrt, sonst direkt aus live. df ist s_unknownDf, wenn der Eintrag nicht aus der Datei stammt.
+	// Jeder Zugriff auf live geschieht unter lock; die Datei wird ohne gelesen.
+	class _DictScan
+	{
+	public:
+		_DictScan( const TermFile* file, Udb::Global* live, const QByteArray& prefix, QMutex* lock ):
+			d_prefix(prefix),d_file(0),d_global(live),d_lock(lock),d_fileEnd(true)
+		{
+			if( file != 0 )
+			{
+				d_file = new TermFile::Iterator( file );
+				d_file->seek( prefix );
+				checkFile();
+			}
+			QMutexLocker l( d_lock );
+			d_live = new Udb::Git( live->findCells( prefix ) );
+			d_livePrefix = prefix;
+			d_liveEnd = d_live->isNull();
+			pick();
+		}
+		~_DictScan()
+		{
+			delete d_file;
+			QMutexLocker l( d_lock );
+			delete d_live;
+		}
+		bool atEnd() const { return !d_fromFile && !d_fromLive; }
+		const QByteArray& key() const { return d_key; }
+		quint32 tid() const { return d_tid; }
+		quint32 df() const { return d_df; }
+		void next()
+		{
+			if( d_fromFile )
+			{
+				d_file->next();
+				checkFile();
+			}
+			QMutexLocker l( d_lock );
+			if( d_fromLive )
+				nextLive();
+			pick();
+		}
+		void skipTo( const QByteArray& key ) // erster Schluessel >= key
+		{
+			if( atEnd() || !( d_key < key ) )
+				return;
+			if( !d_fileEnd )
+			{
+				d_file->seek( key ); // binaere Suche ueber die Bloecke
+				checkFile();
+			}
+			QMutexLocker l( d_lock );
+			seekLive( key );
+			pick();
+		}
+	private:
+		void seekLive( const QByteArray& key ) // unter d_lock
+		{
+			// Nahe Schluessel schrittweise, sonst mit findCells neu aufsetzen statt das Dictionary abzulaufen
+			for( int i = 0; i < s_seekSteps && !d_liveEnd && d_live->getKey() < key; i++ )
+				nextLive();
+			if( d_liveEnd || !( d_live->getKey() < key ) )
+				return;
+			reopenLive( key );
+		}
+		void nextLive() // unter d_lock
+		{
+			d_liveEnd = !d_live->nextKey();
+			if( d_liveEnd && d_livePrefix.size() > d_prefix.size() )
+				reopenLive( _prefixEnd( d_livePrefix ) ); // nach einem Sprung liefert d_live nur dessen Anfang
+		}
+		void reopenLive( QByteArray k ) // unter d_lock; erster Schluessel >= k
+		{
+			// findCells liefert nur die Schluessel mit dem Anfang k; gibt es keine, kommt der naechste
+			// fruehestens bei _prefixEnd(k)
+			for( int i = 0; i < s_seekProbes; i++ )
+			{
+				if( k.isEmpty() || !k.startsWith( d_prefix ) )
+				{
+					d_liveEnd = true; // hinter allen Schluesseln mit prefix
+					return;
+				}
+				Udb::Git git = d_global->findCells( k );
+				if( !git.isNull() )
+				{
+					openLive( git, k );
+					return;
+				}
+				k = _prefixEnd( k );
+			}
+			if( k.isEmpty() || !k.startsWith( d_prefix ) )
+			{
+				d_liveEnd = true;
+				return;
+			}
+			// Zu viele Luecken; im umfassenden Bereich schrittweise weiter
+			const QByteArray p = k.left( qMax( d_prefix.size(), k.size() - 1 ) );
+			openLive( d_global->findCells( p ), p );
+			while( !d_liveEnd && d_live->getKey() < k )
+				nextLive();
+		}
+		void openLive( const Udb::Git& git, const QByteArray& p ) // unter d_lock
+		{
+			delete d_live;
+			d_live = new Udb::Git( git );
+			d_livePrefix = p;
+			d_liveEnd = d_live->isNull();
+			if( d_liveEnd && p.size() > d_prefix.size() )
+				reopenLive( _prefixEnd( p ) );
+		}
+		void checkFile()
+		{
+			d_fileEnd = d_file->atEnd() || d_file->keySize() < d_prefix.size() ||
+					::memcmp( d_file->key(), d_prefix.constData(), d_prefix.size() ) != 0;
+		}
+		void pick() // unter d_lock
+		{
+			d_fromFile = d_fromLive = false;
+			QByteArray live;
+			if( !d_liveEnd )
+				live = d_live->getKey();
+			if( !d_fileEnd )
+			{
+				const QByteArray k = d_file->getKey();
+				if( d_liveEnd || !( live < k ) )
+				{
+					d_key = k;
+					d_tid = d_file->tid();
+					d_df = d_file->df();
+					d_fromFile = true;
+					d_fromLive = !d_liveEnd && live == k; // doppelte Eintraege nur einmal
+				}
+			}
+			if( !d_fromFile && !d_liveEnd )
+			{
+				d_key = live;
+				d_tid = readFreq( d_live->getValue() );
+				d_df = s_unknownDf;
+				d_fromLive = true;
+			}
+		}
+		QByteArray d_prefix;
+		TermFile::Iterator* d_file;
+		Udb::Global* d_global;
+		QMutex* d_lock;
+		Udb::Git* d_live;
+		QByteArray d_livePrefix; // d_live liefert nur Schluessel mit diesem Anfang
+		bool d_fileEnd, d_liveEnd;
+		bool d_fromFile, d_fromLive;
+		QByteArray d_key;
+		quint32 d_tid;
+		quint32 d_df;
+	};
+}
+
 IndexEngine::IndexEngine(const Udb::Obj& index, Udb::Transaction* txn, QObject *parent) :
-	QObject(parent), d_index(index), d_txn(txn), d_tok(0), d_ste(0), d_sto(0),
-	d_useReverseIndex(false),d_resolveDocuments(false),d_checkEmpty(false)
+	QObject(parent), d_index(index), d_queue(0), d_tri(0), d_pos(0), d_delta(0), d_terms(0), d_postCache(0), d_txn(txn), d_tok(0), d_ste(0), d_sto(0),
+	d_useReverseIndex(false),d_useTrigramIndex(false),d_usePositions(false),d_resolveDocuments(false),d_checkEmpty(false),
+	d_change(0),d_pendingSize(0),d_bulkLimit(64*1024*1024),d_bulkLevel(0),
+	d_termCacheSize(0),d_termCacheLimit(8*1024*1024),d_nextTerm(0),d_lastTerm(0),
+	d_queueCount(0),d_lastTicket(0),d_async(false),d_drainScheduled(false),d_rebuildScheduled(false),d_format(RowFormat),
+	d_scoring(FrequencyScoring),d_k1(1.2f),d_b(0.75f),d_expansionLimit(0),d_dictGen(0),d_expansionGen(0),
+	d_deltaCount(0),d_termRebuild(0),d_indexGen(0),d_resultLimit(4*1024*1024),d_resultGen(0),d_resultSize(0),
+	d_resultTick(0),d_resultHits(0),d_resultMisses(0),d_lock(QReadWriteLock::Recursive)
 {
 	Q_ASSERT( !index.isNull() );
+	d_postCache = new PostingCache( 8*1024*1024 );
 	// Damit index in anderer Db sein kann als die Daten, hier txn optional separat
 	if( d_txn == 0 )
 		d_txn = d_index.getTxn();
 	else
 		d_checkEmpty = true;
-	s_cache.insert( txn, this );
-	s_cache.insert( index.getTxn(), this );
+	{
+		QMutexLocker lock( &s_cacheLock );
+		s_cache.insert( txn, this );
+		s_cache.insert( index.getTxn(), this );
+	}
 	quint32 dict = d_index.getValue(AttrDict).getId32();
 	quint32 post = d_index.getValue(AttrPosts).getId32();
 	d_dict = new Udb::Global( d_index.getDb(), this );
@@ -127,12 +585,64 @@ IndexEngine::IndexEngine(const Udb::Obj& index, Udb::Transaction* txn, QObject *
 		d_dict->open(dict);
 		d_post->open(post);
 	}
+	d_format = PostingFormat( d_index.getValue(AttrFormat).getUInt32() );
+	const quint32 tri = d_index.getValue(AttrTrigrams).getId32();
+	if( tri != 0 )
+	{
+		d_tri = new Udb::Global( d_index.getDb(), this );
+		d_tri->open(tri);
+	}
+	const quint32 pos = d_index.getValue(AttrPositions).getId32();
+	if( pos != 0 )
+	{
+		d_pos = new Udb::Global( d_index.getDb(), this );
+		d_pos->open(pos);
+	}
+	const quint32 delta = d_index.getValue(AttrDelta).getId32();
+	if( delta != 0 )
+	{
+		d_delta = new Udb::Global( d_index.getDb(), this );
+		d_delta->open(delta);
+		Udb::Git git = d_delta->findCells( QByteArray() );
+		if( !git.isNull() ) do
+		{
+			d_deltaCount++;
+		}while( git.nextKey() );
+	}
+	const quint32 queue = d_index.getValue(AttrQueue).getId32();
+	if( queue != 0 )
+	{
+		// Allfaellige Eintraege aus einer frueheren Sitzung werden in jedem Fall abgearbeitet
+		d_queue = new Udb::Global( d_index.getDb(), this );
+		d_queue->open(queue);
+		d_lastTicket = d_index.getValue(AttrTicket).getUInt32();
+		Udb::Git git = d_queue->findCells( QByteArray() );
+		if( !git.isNull() ) do
+		{
+			quint32 ticket = 0;
+			readQueueText( git.getValue(), ticket );
+			d_queued[ticket]++;
+			d_queueCount++;
+		}while( git.nextKey() );
+		if( d_queueCount > 0 )
+		{
+			d_drainScheduled = true;
+			QTimer::singleShot( 0, this, SLOT(onDrain()) );
+		}
+	}
 
 	d_txn->addObserver( this, SLOT(onDbUpdate( Udb::UpdateInfo ) ), false );
 }
 
 IndexEngine::~IndexEngine()
 {
+	if( !d_pending.isEmpty() )
+		flushBulk();
+	delete d_terms;
+	delete d_postCache;
+	clearResultCache();
+	clearPools();
+	QMutexLocker lock( &s_cacheLock );
 	s_cache.remove( d_txn );
 	s_cache.remove( d_index.getTxn() );
 }
@@ -149,6 +659,8 @@ void IndexEngine::addTypeToWatch(Udb::Atom a)
 
 void IndexEngine::setTokenizer(Tokenizer *t)
 {
+	QWriteLocker lock( &d_lock );
+	clearPools();
 	if( d_tok && d_tok->parent() == this )
 		delete d_tok;
 	d_tok = t;
@@ -156,6 +668,8 @@ void IndexEngine::setTokenizer(Tokenizer *t)
 
 void IndexEngine::setStemmer(Stemmer *t)
 {
+	QWriteLocker lock( &d_lock );
+	clearPools();
 	if( d_ste && d_ste->parent() == this )
 		delete d_ste;
 	d_ste = t;
@@ -163,6 +677,7 @@ void IndexEngine::setStemmer(Stemmer *t)
 
 void IndexEngine::setStopper(Stopper *s)
 {
+	QWriteLocker lock( &d_lock );
 	if( d_sto && d_sto->parent() == this )
 		delete d_sto;
 	d_sto = s;
@@ -172,8 +687,12 @@ void IndexEngine::indexObject(const Udb::Obj & o, bool removeOldValues)
 {
 	if( o.isNull() || o.equals( d_index ) )
 		return;
+	Q_ASSERT( !holdsReader() ); // siehe Reader
+	QWriteLocker lock( &d_lock );
+	drainAll(); // removeOldValues setzt voraus, dass der committete Wert im Index steht
 	if( d_typesToWatch.isEmpty() || d_typesToWatch.contains( o.getType() ) )
 	{
+		Bulk bulk( this ); // Postings, Laenge und Statistik nur einmal pro Schluessel schreiben
 		QSet<Udb::Atom>::const_iterator i;
 		for( i = d_attrsToWatch.begin(); i != d_attrsToWatch.end(); ++i )
 		{
@@ -181,311 +700,2536 @@ void IndexEngine::indexObject(const Udb::Obj & o, bool removeOldValues)
 				process( o.getValue( (*i), true ), o, true );
 			process( o.getValue( (*i), false ), o, false );
 		}
+		indexPositions( o, removeOldValues );
 	}
 }
 
-IndexEngine::DocHits IndexEngine::findWithJoker(const QString & str, bool itemAnd, bool partial) const
-{
-	QStringList terms = str.toLower().split( QChar('*') ); // keep empty parts
-	if( terms.size() > 2 )
-	{
-		qWarning() << "IndexEngine::findWithJoker: only one joker supported:" << str;
-		return DocHits();
-	}else if( terms.size() == 1 )
-		return find( terms.first(), partial );
-	Q_ASSERT( !terms.isEmpty() );
-	if( !d_useReverseIndex && !terms.last().isEmpty() )
-	{
-		qWarning() << "IndexEngine::findWildcard: not using reverse index; only trailing wildcard supported:" << str;
-		return DocHits();
-	}
-	if( terms.first().isEmpty() && terms.last().isEmpty() )
-		return DocHits();
-	if( terms.last().isEmpty() )
-		return find( terms.first(), !partial ); // invertiere die Wirkung
-	else if( terms.first().isEmpty() )
-		return find( terms.last(), !partial, true );
-	else
-		return intersect( find( terms.first(), true ), find( terms.last(), true, true ), !itemAnd );
-
-}
-
-IndexEngine::DocHits IndexEngine::find(const QString & s, bool partial, bool reverse) const
+void IndexEngine::reindexAll(const QList<Udb::Obj> & objs, int threadCount, bool removeOldValues)
 {
-	Q_ASSERT( !reverse || partial ); // reverse ist immer auch partial!
-
-	if( !d_dict->isOpen() )
-		return DocHits();
-
-	const QString str = s.toLower();
-	QString term = str;
-	if( term.endsWith(QLatin1String("*")) ) // "trailing wildcard query" kann auch hier direkt verarbeitet werden
-	{
-		partial = true;
-		term.chop(1);
-	}else if( term.endsWith(QLatin1String("!")) )
+	if( d_tok == 0 )
 	{
-		partial = false;
-		term.chop(1);
+		qWarning() << "IndexEngine::reindexAll: no Tokenizer set";
+		return;
 	}
-	if( d_ste != 0 ) // && !partial // ohne stem findet man hits wie z.B. zu "companies" nicht
-		term = d_ste->stem( term );
-	QList<quint32> nrs;
-	if( partial || reverse )
+	drainAll();
+	if( threadCount <= 0 )
+		threadCount = QThread::idealThreadCount();
+	const int queueSize = 4 * threadCount;
+	_Queue<_Job> in( queueSize );
+	_Queue<_Result> out( queueSize );
+	QList<_Analyzer*> workers;
+	for( int i = 0; i < threadCount; i++ )
 	{
-		if( reverse )
-			term = _reverse(term);
-		QByteArray key;
-		Udb::Idx::collate( key, 0, term ); // Udb::IndexMeta::NFKD_CanonicalBase, s.toLower() );
-		if( reverse )
-			key.prepend(s_rev);
-		Udb::Git git = d_dict->findCells( key );
-		if( !git.isNull() ) do
+		Tokenizer* tok = d_tok->clone();
+		Stemmer* ste = ( d_ste ) ? d_ste->clone() : 0;
+		Stopper* sto = ( d_sto ) ? d_sto->clone() : 0;
+		if( tok == 0 || ( d_ste && ste == 0 ) || ( d_sto && sto == 0 ) )
 		{
-			nrs.append( readFreq( git.getValue() ) );
-		}while( git.nextKey() );
-	}else
-	{
-		const quint32 nr = const_cast<IndexEngine*>(this)->termId( str, false );
-		if( nr != 0 )
-			nrs.append( nr );
+			delete tok;
+			delete ste;
+			delete sto;
+			break; // nicht klonbar; was bisher da ist muss reichen
+		}
+		workers.append( new _Analyzer( &in, &out, tok, ste, sto, keepRaw() ) );
+		workers.last()->start();
 	}
-	QMap<Udb::OID,DocHit> hits;
-	foreach( quint32 nr, nrs )
+
+	Bulk bulk( this );
+	// Die Positionen zerlegen ebenfalls die Analyse-Threads; hier werden nur noch die Term-IDs aufgeloest
+	const bool positions = d_pos != 0 && d_usePositions;
+	// Die Resultate werden in der Reihenfolge von objs geschrieben, damit die Term-IDs reproduzierbar sind
+	QMap<int,_Result> ready;
+	_Job job;
+	job.d_seq = -1;
+	int next = 0;
+	int seq = 0;
+	while( next < objs.size() )
 	{
-		Udb::Git m = d_post->findCells( writeFreq( nr ) );
-		DocHit* hit1 = 0;
-		ItemHits hit2;
-		if( !m.isNull() ) do
+		if( job.d_seq < 0 && seq < objs.size() )
 		{
-			// Hier kommen die ItemHits bereits nach OID sortiert.
-			// Zuerst kommt immer der DocHit, gefolgt von allen ItemHits des Doc
-			// Es kann sein, dass mehrere nr auf dasselbe Doc zeigen; darum unite der Teilergebnisse
-			Udb::OID doc = 0, item = 0;
-			const int n = readKey3( m.getKey(), nr, doc, item );
-			if( n == 2 )
+			// Udb ist nicht threadsicher, darum werden die Werte hier gelesen
+			job.d_seq = seq++;
+			job.d_old.clear();
+			job.d_new.clear();
+			job.d_attrs.clear();
+			const Udb::Obj& o = objs[job.d_seq];
+			if( !o.isNull() && !o.equals( d_index ) &&
+					( d_typesToWatch.isEmpty() || d_typesToWatch.contains( o.getType() ) ) )
 			{
-				if( hit1 )
+				QSet<Udb::Atom>::const_iterator i;
+				for( i = d_attrsToWatch.begin(); i != d_attrsToWatch.end(); ++i )
 				{
-					hit1->d_items = unite( hit1->d_items, hit2 );
-					hit2.clear();
+					if( removeOldValues )
+						job.d_old.append( o.getValue( (*i), true ).toString(true) );
+					job.d_new.append( o.getValue( (*i), false ).toString(true) );
+					if( positions )
+						job.d_attrs.append( (*i) );
 				}
-				hit1 = &hits[ doc ];
-				hit1->d_doc = doc;
-				hit1->d_rank += readFreq( m.getValue() );
-			}else if( n == 3 )
-			{
-				Q_ASSERT( hit1 != 0 && hit1->d_doc == doc );
-				ItemHit h;
-				h.d_item = item;
-				h.d_rank = readFreq( m.getValue() );
-				hit2.append( h );
 			}
-		}while( m.nextKey() );
-		if( hit1 )
-			hit1->d_items = unite( hit1->d_items, hit2 );
+		}
+		_Result res;
+		if( job.d_seq >= 0 && workers.isEmpty() )
+		{
+			QWriteLocker lock( &d_lock ); // ohne Klone teilen sich die Abfragen d_tok und d_ste
+			ready[job.d_seq].analyze( job, d_tok, d_ste, d_sto, keepRaw() );
+			job.d_seq = -1;
+		}else if( job.d_seq >= 0 && in.tryPush( job ) )
+			job.d_seq = -1;
+		else if( out.pop( res ) ) // blockiert nur, solange Jobs unterwegs sind
+			ready.insert( res.d_seq, res );
+		while( !ready.isEmpty() && ready.begin().key() == next )
+		{
+			QWriteLocker lock( &d_lock ); // die Abfragen kommen zwischen den Objekten dran
+			const _Result r = ready.take( next );
+			applyTerms( r.d_terms, objs[next] );
+			for( int i = 0; i < r.d_attrs.size(); i++ )
+				writePositions( objs[next], r.d_attrs[i], r.d_oldPos[i], r.d_newPos[i] );
+			next++;
+		}
+	}
+	in.close();
+	foreach( _Analyzer* w, workers )
+	{
+		w->wait();
+		delete w;
 	}
-	DocHits res;
-	QMap<Udb::OID,DocHit>::const_iterator i;
-	for( i = hits.begin(); i != hits.end(); ++i )
-		res.append(i.value());
-	return res;
 }
 
-IndexEngine::DocHits IndexEngine::find(const QStringList & l, bool docAnd, bool itemAnd, bool joker, bool partial) const
+void IndexEngine::analyze(const QString & str, qint32 sign, Terms & res, Tokenizer * tok, Stemmer * ste, Stopper * sto, bool keepRaw)
 {
-	DocHits res;
-	if( docAnd )
+	tok->setString( str );
+	QString t = tok->nextToken();
+	while( !t.isEmpty() )
 	{
-		// AND
-		for( int i = 0; i < l.size(); i++ )
+		if( sto == 0 || !sto->isStopword( t ) )
 		{
-			if( i == 0 )
-				res = (joker)?findWithJoker(l[i],itemAnd,partial):find( l[i], partial );
-			else
-				res = intersect( res, (joker)?findWithJoker(l[i],itemAnd,partial):find( l[i], partial ), !itemAnd );
+			Term& term = res[ ( ste ) ? ste->stem( t ) : t ];
+			term.d_freq += sign;
+			if( keepRaw && !term.d_raw.contains( t ) )
+				term.d_raw.append( t );
 		}
-	}else
+		t = tok->nextToken();
+	}
+}
+
+void IndexEngine::analyzePositions(const QString & str, Positions & res, Tokenizer * tok, Stemmer * ste, Stopper * sto)
+{
+	// Stoppwoerter werden nicht gespeichert, zaehlen aber fuer die Position
+	tok->setString( str );
+	QString t = tok->nextToken();
+	quint32 pos = 0;
+	while( !t.isEmpty() )
+	{
+		if( sto == 0 || !sto->isStopword( t ) )
+			res[ ( ste ) ? ste->stem( t ) : t ].append( pos );
+		pos++;
+		t = tok->nextToken();
+	}
+}
+
+bool IndexEngine::setPostingFormat(PostingFormat f)
+{
+	if( f == d_format )
+		return true;
+	QWriteLocker lock( &d_lock );
+	if( !d_dict->isOpen() || hasTerms() )
+	{
+		qWarning() << "IndexEngine::setPostingFormat: format can only be changed on an empty index";
+		return false;
+	}
+	d_format = f;
+	d_index.setValue( AttrFormat, Stream::DataCell().setUInt32( f ) );
+	d_index.commit();
+	return true;
+}
+
+void IndexEngine::useTrigramIndex(bool on)
+{
+	QWriteLocker lock( &d_lock );
+	if( on && d_tri == 0 )
+	{
+		if( d_index.getTxn()->isReadOnly() || !d_dict->isOpen() )
+			return;
+		d_tri = new Udb::Global( d_index.getDb(), this );
+		d_index.setValue(AttrTrigrams, Stream::DataCell().setId32( d_tri->create() ) );
+		d_index.commit();
+	}
+	d_useTrigramIndex = on;
+}
+
+void IndexEngine::usePositions(bool on)
+{
+	QWriteLocker lock( &d_lock );
+	if( on && d_pos == 0 )
+	{
+		if( d_index.getTxn()->isReadOnly() || !d_dict->isOpen() )
+			return;
+		d_pos = new Udb::Global( d_index.getDb(), this );
+		d_index.setValue(AttrPositions, Stream::DataCell().setId32( d_pos->create() ) );
+		d_index.commit();
+	}
+	d_usePositions = on;
+}
+
+void IndexEngine::setAsync(bool on)
+{
+	QWriteLocker lock( &d_lock );
+	if( !on )
+		drainAll(); // sonst wuerde der synchrone Modus auf einem aelteren Stand als dem committeten aufsetzen
+	if( on && d_queue == 0 )
+	{
+		if( d_index.getTxn()->isReadOnly() || !d_dict->isOpen() )
+			return;
+		d_queue = new Udb::Global( d_index.getDb(), this );
+		d_index.setValue(AttrQueue, Stream::DataCell().setId32( d_queue->create() ) );
+		d_index.commit();
+	}
+	d_async = on;
+}
+
+quint32 IndexEngine::getIndexedTicket() const
+{
+	QReadLocker lock( &d_lock );
+	if( d_queued.isEmpty() )
+		return d_lastTicket;
+	else
+		return d_queued.begin().key() - 1;
+}
+
+bool IndexEngine::waitForIndexed(quint32 ticket, int msecs)
+{
+	// Da Udb nicht threadsicher ist, wird hier nicht gewartet sondern die Queue selber abgearbeitet
+	QElapsedTimer t;
+	t.start();
+	while( getIndexedTicket() < ticket && d_queueCount > 0 )
+	{
+		if( msecs >= 0 && t.elapsed() > msecs )
+			return false;
+		drainQueue( s_drainBatch );
+	}
+	return true;
+}
+
+void IndexEngine::drainAll()
+{
+	while( d_queueCount > 0 )
+		drainQueue( s_drainBatch );
+}
+
+void IndexEngine::onDrain()
+{
+	d_drainScheduled = false;
+	QElapsedTimer t;
+	t.start();
+	while( d_queueCount > 0 && t.elapsed() < s_drainSlice )
+		drainQueue( s_drainBatch );
+	if( d_queueCount > 0 && !d_drainScheduled )
+	{
+		d_drainScheduled = true;
+		QTimer::singleShot( 0, this, SLOT(onDrain()) );
+	}
+}
+
+void IndexEngine::enqueue(const Udb::Obj & o, Udb::Atom attr, quint32 ticket)
+{
+	const QByteArray key = writeQueueKey( o.getOid(), attr );
+	if( !d_queue->getCell( key ).isEmpty() )
+		return; // der aeltere Eintrag enthaelt bereits den Wert, der im Index steht
+	QByteArray val = writeFreq( ticket );
+	val += o.getValue( attr, true ).toString(true).toUtf8();
+	d_queue->setCell( key, val );
+	d_queued[ticket]++;
+	d_queueCount++;
+}
+
+int IndexEngine::drainQueue(int maxEntries)
+{
+	Q_ASSERT( !holdsReader() ); // siehe Reader
+	QWriteLocker lock( &d_lock );
+	if( d_queue == 0 || d_queueCount == 0 )
+		return 0;
+	// Zuerst sammeln, da d_queue waehrend der Iteration nicht veraendert werden soll
+	QList< QPair<QByteArray,QByteArray> > batch;
+	Udb::Git git = d_queue->findCells( QByteArray() );
+	if( !git.isNull() ) do
+	{
+		batch.append( qMakePair( git.getKey(), git.getValue() ) );
+	}while( batch.size() < maxEntries && git.nextKey() );
+	beginBulk();
+	for( int i = 0; i < batch.size(); i++ )
+	{
+		Udb::OID oid = 0;
+		Udb::Atom attr = 0;
+		readQueueKey( batch[i].first, oid, attr );
+		quint32 ticket = 0;
+		const QString old = readQueueText( batch[i].second, ticket );
+		Udb::Obj o = d_txn->getObject( oid );
+		// Es wird der zuletzt committete Stand indiziert; was noch in d_txn haengt, kommt mit dem naechsten Commit
+		const Stream::DataCell value = o.getValue( attr, true );
+		processChange( Stream::DataCell().setString( old ), value, o );
+		indexPositions( o, attr, old, value.toString(true) );
+		d_queue->setCell( batch[i].first, QByteArray() );
+		QMap<quint32,int>::iterator j = d_queued.find( ticket );
+		if( j != d_queued.end() && --j.value() <= 0 )
+			d_queued.erase( j );
+		d_queueCount--;
+	}
+	endBulk();
+	if( d_queueCount < 0 || batch.isEmpty() )
+	{
+		d_queued.clear();
+		d_queueCount = 0;
+	}
+	commit();
+	return batch.size();
+}
+
+void IndexEngine::beginBulk()
+{
+	QWriteLocker lock( &d_lock );
+	d_bulkLevel++;
+}
+
+void IndexEngine::endBulk()
+{
+	QWriteLocker lock( &d_lock );
+	Q_ASSERT( d_bulkLevel > 0 );
+	d_bulkLevel--;
+	if( d_bulkLevel == 0 )
+		flushBulk();
+}
+
+void IndexEngine::flushBulk()
+{
+	QWriteLocker lock( &d_lock );
+	if( d_pending.isEmpty() )
+		return;
+	// In Schluesselreihenfolge von d_post schreiben, damit die Btree-Seiten nacheinander besucht werden
+	QVector<Delta> deltas;
+	deltas.reserve( d_pending.size() );
+	QHash<QByteArray,qint32>::const_iterator i;
+	for( i = d_pending.begin(); i != d_pending.end(); ++i )
+	{
+		if( i.value() != 0 )
+			deltas.append( qMakePair( i.key(), i.value() ) );
+	}
+	d_pending.clear();
+	d_pendingSize = 0;
+	qSort( deltas );
+	if( d_format == BlockFormat )
+	{
+		// Die Schluessel beginnen mit der Term-Nummer, also liegen alle Deltas eines Terms beieinander
+		int j = 0;
+		while( j < deltas.size() )
+		{
+			const quint32 tid = readFreq( deltas[j].first );
+			int k = j + 1;
+			while( k < deltas.size() && readFreq( deltas[k].first ) == tid )
+				k++;
+			if( tid == s_lengthTerm )
+			{
+				for( int l = j; l < k; l++ )
+					writePosting( deltas[l].first, deltas[l].second );
+				flushStats();
+			}else
+				writeBlockDeltas( tid, deltas, j, k );
+			j = k;
+		}
+	}else
+	{
+		for( int j = 0; j < deltas.size(); j++ )
+			writePosting( deltas[j].first, deltas[j].second );
+		flushStats();
+	}
+}
+
+void IndexEngine::setTermCacheLimit(quint32 bytes)
+{
+	QWriteLocker lock( &d_lock );
+	d_termCacheLimit = bytes;
+	trimTermCache();
+}
+
+void IndexEngine::clearTermCache()
+{
+	QWriteLocker lock( &d_lock );
+	d_termCache.clear();
+	d_revCache.clear();
+	d_triCache.clear();
+	d_termCacheSize = 0;
+}
+
+IndexEngine::DocHits IndexEngine::findWithJoker(const QString & str, bool itemAnd, bool partial) const
+{
+	return findHitsWithJoker( str, itemAnd, partial ).toDocHits();
+}
+
+IndexEngine::DocHits IndexEngine::find(const QString & s, bool partial, bool reverse) const
+{
+	return findHits( s, partial, reverse ).toDocHits();
+}
+
+IndexEngine::DocHits IndexEngine::find(const QStringList & l, bool docAnd, bool itemAnd, bool joker, bool partial) const
+{
+	return findHits( l, docAnd, itemAnd, joker, partial ).toDocHits();
+}
+
+HitList IndexEngine::findHitsWithJoker(const QString & str, bool itemAnd, bool partial) const
+{
+	QReadLocker lock( &d_lock );
+	QStringList terms = str.toLower().split( QChar('*') ); // keep empty parts
+	if( terms.size() > 2 || str.contains( QChar('?') ) || ( !d_useReverseIndex && !terms.last().isEmpty() ) )
+	{
+		// Mehrere Joker oder ohne reverse Index: ueber die Originalformen mit dem Trigramm-Index, sonst und
+		// wenn das Muster keine drei Zeichen am Stueck hat mit dem Automaten ueber das Dictionary
+		if( d_tri != 0 && !_patternTrigrams( str.toLower() ).isEmpty() )
+			return findHitsWithPattern( str );
+		return findHitsMatching( str, PatternAutomaton::Glob );
+	}else if( terms.size() == 1 )
+		return findHits( terms.first(), partial );
+	Q_ASSERT( !terms.isEmpty() );
+	if( terms.first().isEmpty() && terms.last().isEmpty() )
+		return HitList();
+	if( terms.last().isEmpty() )
+		return findHits( terms.first(), !partial ); // invertiere die Wirkung
+	else if( terms.first().isEmpty() )
+		return findHits( terms.last(), !partial, true );
+	else
+		return HitList::intersect( findHits( terms.first(), true ), findHits( terms.last(), true, true ), !itemAnd );
+
+}
+
+IndexEngine::DocHits IndexEngine::findMatching(const QString & pattern, int syntax) const
+{
+	return findHitsMatching( pattern, syntax ).toDocHits();
+}
+
+HitList IndexEngine::findHitsMatching(const QString & pattern, int syntax) const
+{
+	QReadLocker lock( &d_lock );
+	const PatternAutomaton a( pattern.toLower(), PatternAutomaton::Syntax( syntax ) );
+	if( !a.isValid() )
+	{
+		qWarning() << "IndexEngine::findMatching: invalid pattern:" << pattern << a.getError();
+		return HitList();
+	}
+	QList<HitList> lists;
+	foreach( quint32 nr, automatonIds( a ) )
+		lists.append( readHits( nr ) );
+	return HitList::unite( lists, true );
+}
+
+QStringList IndexEngine::findFuzzyTerms(const QString & term, int maxEdits, bool transpositions, int prefixLength) const
+{
+	QReadLocker lock( &d_lock );
+	QStringList res;
+	const QList<TermMatch> terms = fuzzyTerms( term, maxEdits, transpositions, prefixLength );
+	for( int i = 0; i < terms.size(); i++ )
+		res.append( terms[i].first );
+	return res;
+}
+
+IndexEngine::DocHits IndexEngine::findFuzzy(const QString & term, int maxEdits, bool transpositions, int prefixLength) const
+{
+	return findHitsFuzzy( term, maxEdits, transpositions, prefixLength ).toDocHits();
+}
+
+HitList IndexEngine::findHitsFuzzy(const QString & term, int maxEdits, bool transpositions, int prefixLength) const
+{
+	QReadLocker lock( &d_lock );
+	const QList<TermMatch> terms = fuzzyTerms( term, maxEdits, transpositions, prefixLength );
+	QList<HitList> lists;
+	for( int i = 0; i < terms.size(); i++ )
+		lists.append( readHits( terms[i].second ) );
+	return HitList::unite( lists, true );
+}
+
+QList<IndexEngine::TermMatch> IndexEngine::fuzzyTerms(const QString & s, int maxEdits, bool transpositions, int prefixLength) const
+{
+	const QString term = stemTerm( s.toLower() ); // wie termIds
+	prefixLength = qBound( 0, prefixLength, term.size() );
+	const LevenshteinAutomaton a( term.mid( prefixLength ), qBound( 0, maxEdits, 2 ), transpositions );
+	return automatonTerms( a, term.left( prefixLength ) );
+}
+
+QList<quint32> IndexEngine::automatonIds(const Automaton & a, const QString & prefix) const
+{
+	QList<quint32> res;
+	const QList<TermMatch> terms = automatonTerms( a, prefix );
+	for( int i = 0; i < terms.size(); i++ )
+		res.append( terms[i].second );
+	return res;
+}
+
+QList<IndexEngine::TermMatch> IndexEngine::automatonTerms(const Automaton & a, const QString & prefix) const
+{
+	QList<TermMatch> res;
+	if( !d_dict->isOpen() )
+		return res;
+	int budget = s_maxRanges;
+	matchRange( a, a.start(), prefix, budget, res );
+	return res;
+}
+
+void IndexEngine::matchRange(const Automaton & a, int state, const QString & prefix, int & budget, QList<TermMatch> & res) const
+{
+	QList<QChar> chars;
+	if( budget > 0 && a.explicitChars( state, chars ) )
+	{
+		// Nur die Teilbereiche der moeglichen naechsten Zeichen lesen
+		budget--;
+		if( a.isAccepting( state ) && !prefix.isEmpty() )
+		{
+			QByteArray key;
+			Udb::Idx::collate( key, 0, prefix );
+			const quint32 id = lookupDict( key );
+			if( id != 0 )
+				res.append( TermMatch( prefix, id ) );
+		}
+		foreach( QChar c, chars )
+		{
+			const int next = a.step( state, c );
+			if( next != -1 )
+				matchRange( a, next, prefix + c, budget, res );
+		}
+		return;
+	}
+	QByteArray key;
+	if( !prefix.isEmpty() )
+		Udb::Idx::collate( key, 0, prefix );
+	_DictScan scan( d_terms, ( d_terms ) ? d_delta : d_dict, key, &d_dbLock );
+	while( !scan.atEnd() )
+	{
+		const QByteArray k = scan.key();
+		if( k.isEmpty() || k[0] == s_rev )
+		{
+			scan.skipTo( QByteArray( 1, s_rev + 1 ) );
+			continue;
+		}
+		// Der Automat laeuft ueber die Zeichen; das geht nur, wenn der Schluessel umkehrbar ist
+		const QString term = QString::fromUtf8( k );
+		QByteArray check;
+		Udb::Idx::collate( check, 0, term );
+		if( check != k || !term.startsWith( prefix ) )
+		{
+			scan.next();
+			continue;
+		}
+		int s = state;
+		int i = prefix.size();
+		while( i < term.size() && s != -1 )
+			s = a.step( s, term[i++] );
+		if( s == -1 )
+		{
+			// Terme mit diesem Anfang koennen nicht mehr passen; skipTo setzt direkt dahinter auf
+			const QByteArray dead = _prefixEnd( term.left( i ).toUtf8() );
+			if( dead.isEmpty() )
+				break;
+			scan.skipTo( dead );
+		}else
+		{
+			if( a.isAccepting( s ) )
+				res.append( TermMatch( term, scan.tid() ) );
+			scan.next();
+		}
+	}
+}
+
+IndexEngine::DocHits IndexEngine::findWithPattern(const QString & pattern) const
+{
+	return findHitsWithPattern( pattern ).toDocHits();
+}
+
+HitList IndexEngine::findHitsWithPattern(const QString & pattern) const
+{
+	QReadLocker lock( &d_lock );
+	QList<HitList> lists;
+	foreach( quint32 nr, patternIds( pattern ) )
+		lists.append( readHits( nr ) );
+	return HitList::unite( lists, true );
+}
+
+static bool _globMatch( const QString& pat, const QString& str )
+{
+	// '*' beliebig viele, '?' genau ein Zeichen; beim Fehlschlag wird der letzte '*' um ein Zeichen verlaengert
+	int p = 0, s = 0, star = -1, mark = 0;
+	while( s < str.size() )
+	{
+		if( p < pat.size() && ( pat[p] == QChar('?') || pat[p] == str[s] ) )
+		{
+			p++;
+			s++;
+		}else if( p < pat.size() && pat[p] == QChar('*') )
+		{
+			star = p++;
+			mark = s;
+		}else if( star != -1 )
+		{
+			p = star + 1;
+			s = ++mark;
+		}else
+			return false;
+	}
+	while( p < pat.size() && pat[p] == QChar('*') )
+		p++;
+	return p == pat.size();
+}
+
+QList<quint32> IndexEngine::patternIds(const QString & pattern) const
+{
+	QList<quint32> res;
+	if( d_tri == 0 )
+	{
+		qWarning() << "IndexEngine::findWithPattern: no trigram index:" << pattern;
+		return res;
+	}
+	const QString pat = pattern.toLower();
+	const QSet<QString> tris = _patternTrigrams( pat );
+	if( tris.isEmpty() )
+	{
+		qWarning() << "IndexEngine::findWithPattern: pattern needs three consecutive characters:" << pattern;
+		return res;
+	}
+
+	// Seltenstes Trigramm zuerst; ist eines nicht vorhanden, gibt es keinen Treffer
+	QMutexLocker lock( &d_dbLock );
+	QList<QPair<quint32,QString> > order;
+	foreach( const QString& tri, tris )
+	{
+		const quint32 count = readFreq( d_tri->getCell( tri.toUtf8() ) );
+		if( count == 0 )
+			return res;
+		order.append( qMakePair( count, tri ) );
+	}
+	qSort( order );
+
+	// Kandidaten (Term UTF-8 -> Stamm-ID) aus der kuerzesten Liste, danach mit den weiteren Listen schneiden;
+	// ist die Liste laenger als die Kandidaten, wird pro Kandidat nachgeschlagen statt die Liste gelesen
+	QList<QPair<QByteArray,quint32> > cand;
+	const QByteArray first = writeTriKey( order.first().second, QByteArray() );
+	Udb::Git git = d_tri->findCells( first );
+	if( !git.isNull() ) do
+	{
+		cand.append( qMakePair( git.getKey().mid( first.size() ), readFreq( git.getValue() ) ) );
+	}while( git.nextKey() );
+	for( int k = 1; k < order.size() && !cand.isEmpty(); k++ )
+	{
+		QList<QPair<QByteArray,quint32> > next;
+		if( quint32(cand.size()) < order[k].first )
+		{
+			for( int i = 0; i < cand.size(); i++ )
+			{
+				if( !d_tri->getCell( writeTriKey( order[k].second, cand[i].first ) ).isEmpty() )
+					next.append( cand[i] );
+			}
+		}else
+		{
+			const QByteArray prefix = writeTriKey( order[k].second, QByteArray() );
+			QSet<QByteArray> terms;
+			Udb::Git git = d_tri->findCells( prefix );
+			if( !git.isNull() ) do
+			{
+				terms.insert( git.getKey().mid( prefix.size() ) );
+			}while( git.nextKey() );
+			for( int i = 0; i < cand.size(); i++ )
+			{
+				if( terms.contains( cand[i].first ) )
+					next.append( cand[i] );
+			}
+		}
+		cand = next;
+	}
+
+	// Die Trigramme sind nur notwendig; die Reihenfolge der Literale prueft erst das Muster
+	QSet<quint32> found;
+	for( int i = 0; i < cand.size(); i++ )
+	{
+		if( !found.contains( cand[i].second ) && _globMatch( pat, QString::fromUtf8( cand[i].first ) ) )
+		{
+			found.insert( cand[i].second );
+			res.append( cand[i].second );
+		}
+	}
+	return res;
+}
+
+HitList IndexEngine::findHits(const QString & s, bool partial, bool reverse) const
+{
+	QReadLocker lock( &d_lock );
+	// Es kann sein, dass mehrere nr auf dasselbe Doc zeigen; darum unite der Teilergebnisse
+	QList<HitList> lists;
+	foreach( quint32 nr, termIds( s, partial, reverse ) )
+		lists.append( readHits( nr ) );
+	return HitList::unite( lists, true );
+}
+
+QList<quint32> IndexEngine::termIds(const QString & s, bool partial, bool reverse) const
+{
+	Q_ASSERT( !reverse || partial ); // reverse ist immer auch partial!
+
+	QList<quint32> nrs;
+	if( !d_dict->isOpen() )
+		return nrs;
+
+	const QString str = s.toLower();
+	QString term = str;
+	if( term.endsWith(QLatin1String("*")) ) // "trailing wildcard query" kann auch hier direkt verarbeitet werden
+	{
+		partial = true;
+		term.chop(1);
+	}else if( term.endsWith(QLatin1String("!")) )
+	{
+		partial = false;
+		term.chop(1);
+	}
+	term = stemTerm( term ); // auch mit partial, ohne stem findet man hits wie z.B. zu "companies" nicht
+	if( partial || reverse )
+	{
+		if( reverse )
+			term = _reverse(term);
+		QByteArray key;
+		Udb::Idx::collate( key, 0, term ); // Udb::IndexMeta::NFKD_CanonicalBase, s.toLower() );
+		if( reverse )
+			key.prepend(s_rev);
+		nrs = expandPrefix( key );
+	}else
+	{
+		const quint32 nr = findStem( term ); // term ist bereits stemmed
+		if( nr != 0 )
+			nrs.append( nr );
+	}
+	return nrs;
+}
+
+static bool _higherDf( const IndexEngine::ExpandedTerm& lhs, const IndexEngine::ExpandedTerm& rhs )
+{
+	return lhs.d_df > rhs.d_df || ( lhs.d_df == rhs.d_df && lhs.d_key < rhs.d_key );
+}
+
+QList<quint32> IndexEngine::expandPrefix(const QByteArray & key) const
+{
+	Expansion terms;
+	bool found = false;
+	{
+		QMutexLocker lock( &d_cacheLock );
+		if( d_expansionGen != d_dictGen )
+		{
+			// Dictionary hat sich geaendert
+			d_expansions.clear();
+			d_expansionGen = d_dictGen;
+		}
+		int exact = -1, base = -1;
+		for( int i = 0; i < d_expansions.size(); i++ )
+		{
+			const QByteArray& k = d_expansions[i].first;
+			if( k == key )
+			{
+				exact = i;
+				break;
+			}
+			if( key.startsWith( k ) && ( base == -1 || k.size() > d_expansions[base].first.size() ) )
+				base = i;
+		}
+		if( exact != -1 )
+			terms = d_expansions.takeAt( exact ).second;
+		else if( base != -1 )
+		{
+			// Beim Weitertippen aus der Expansion des kuerzeren Praefix ableiten, ohne das Dictionary zu lesen
+			const Expansion& b = d_expansions[base].second;
+			for( int i = 0; i < b.size(); i++ )
+			{
+				if( b[i].d_key.startsWith( key ) )
+					terms.append( b[i] );
+			}
+		}
+		found = exact != -1 || base != -1;
+	}
+	if( !found )
+	{
+		for( _DictScan scan( d_terms, ( d_terms ) ? d_delta : d_dict, key, &d_dbLock ); !scan.atEnd(); scan.next() )
+		{
+			ExpandedTerm t;
+			t.d_key = scan.key();
+			t.d_tid = scan.tid();
+			t.d_df = scan.df();
+			terms.append( t );
+		}
+	}
+	const bool capped = d_expansionLimit != 0 && quint32(terms.size()) > d_expansionLimit;
+	if( capped )
+	{
+		// df nur lesen, wenn tatsaechlich begrenzt wird; bleibt im Cache fuer die laengeren Praefixe
+		for( int i = 0; i < terms.size(); i++ )
+		{
+			if( terms[i].d_df == s_unknownDf )
+				terms[i].d_df = readTermStats( terms[i].d_tid ).d_df;
+		}
+	}
+	{
+		QMutexLocker lock( &d_cacheLock );
+		for( int i = 0; i < d_expansions.size(); i++ )
+		{
+			if( d_expansions[i].first == key )
+			{
+				d_expansions.removeAt( i ); // inzwischen von einer anderen Abfrage eingetragen
+				break;
+			}
+		}
+		d_expansions.prepend( qMakePair( key, terms ) );
+		while( d_expansions.size() > s_expansionCacheSize )
+			d_expansions.removeLast();
+	}
+
+	QList<quint32> res;
+	if( capped )
+	{
+		std::partial_sort( terms.begin(), terms.begin() + d_expansionLimit, terms.end(), _higherDf );
+		for( quint32 i = 0; i < d_expansionLimit; i++ )
+			res.append( terms[i].d_tid );
+	}else
+	{
+		for( int i = 0; i < terms.size(); i++ )
+			res.append( terms[i].d_tid );
+	}
+	return res;
+}
+
+void IndexEngine::setExpansionLimit(quint32 limit)
+{
+	QWriteLocker lock( &d_lock );
+	d_expansionLimit = limit;
+	d_indexGen++;
+}
+
+void IndexEngine::clearExpansionCache()
+{
+	QMutexLocker lock( &d_cacheLock );
+	d_expansions.clear();
+}
+
+IndexEngine::TermStats IndexEngine::getTermStats(const QString & term) const
+{
+	QReadLocker lock( &d_lock );
+	const QList<quint32> nrs = termIds( term, false, false );
+	if( nrs.isEmpty() )
+		return TermStats();
+	return getTermStats( nrs.first() );
+}
+
+IndexEngine::TermStats IndexEngine::getTermStats(quint32 tid) const
+{
+	QReadLocker lock( &d_lock );
+	return readTermStats( tid );
+}
+
+IndexEngine::TermStats IndexEngine::readTermStats(quint32 tid) const
+{
+	if( !d_post->isOpen() || tid == 0 )
+		return TermStats();
+	QMutexLocker lock( &d_dbLock );
+	if( d_format == BlockFormat )
+	{
+		PostingCodec::Head head;
+		PostingCodec::readHead( d_post->getCell( writeFreq( tid ) ), head );
+		TermStats res;
+		for( int i = 0; i < head.d_pages.size(); i++ )
+			res.d_df += head.d_pages[i].d_count;
+		for( int i = 0; i < head.d_blocks.size(); i++ )
+			res.d_df += head.d_blocks[i].d_count;
+		res.d_ttf = head.d_ttf;
+		return res;
+	}
+	return readStats( d_post->getCell( writeFreq( tid ) ) );
+}
+
+quint64 IndexEngine::estimateDocs(const QString & s, bool joker, bool partial) const
+{
+	// Gleiche Fallunterscheidung wie findHitsWithJoker, aber nur mit den Statistiken der Terme
+	const QStringList terms = ( joker ) ? s.toLower().split( QChar('*') ) : QStringList() << s;
+	if( terms.size() > 2 )
+		return 0;
+	quint64 first = 0, last = 0;
+	if( terms.size() == 1 )
+	{
+		foreach( quint32 nr, termIds( terms.first(), partial, false ) )
+			first += readTermStats( nr ).d_df;
+		return first;
+	}
+	if( terms.first().isEmpty() && terms.last().isEmpty() )
+		return 0;
+	if( !d_useReverseIndex && !terms.last().isEmpty() )
+		return 0;
+	if( !terms.first().isEmpty() )
+	{
+		foreach( quint32 nr, termIds( terms.first(), terms.last().isEmpty() ? !partial : true, false ) )
+			first += readTermStats( nr ).d_df;
+		if( terms.last().isEmpty() )
+			return first;
+	}
+	foreach( quint32 nr, termIds( terms.last(), terms.first().isEmpty() ? !partial : true, true ) )
+		last += readTermStats( nr ).d_df;
+	if( terms.first().isEmpty() )
+		return last;
+	return qMin( first, last );
+}
+
+HitList IndexEngine::readHits(quint32 nr, bool score) const
+{
+	HitList res;
+	QMutexLocker lock( &d_cacheLock );
+	if( d_postCache->getLimit() == 0 || !d_postCache->find( nr, res ) )
+	{
+		lock.unlock(); // die anderen Abfragen dekodieren derweil weiter
+		res = decodeHits( nr );
+		lock.relock();
+		if( d_postCache->getLimit() != 0 )
+			d_postCache->insert( nr, res );
+	}
+	lock.unlock();
+	const Scorer scorer = ( score ) ? Scorer( this, nr ) : Scorer();
+	if( scorer.usesLength() )
+	{
+		LengthReader reader( this, res.size() );
+		const QVector<quint32> lengths = reader.lengths( res.docs() );
+		for( int k = 0; k < res.size(); k++ )
+			res.setRank( k, scorer.score( res.rank( k ), lengths[k] ) );
+	}
+	return res;
+}
+
+HitList IndexEngine::decodeHits(quint32 nr) const
+{
+	HitList res;
+	if( d_format == BlockFormat )
+	{
+		PostingCodec::Head head;
+		PostingCodec::readHead( readHeadCell( nr ), head );
+		PostingCodec::BlockDir dir = head.d_blocks;
+		for( int i = 0; i < head.d_pages.size(); i++ )
+			PostingCodec::readPage( readBlockCell( nr, head.d_pages[i].d_no ), dir );
+		for( int i = 0; i < dir.size(); i++ )
+			PostingCodec::readBlock( readBlockCell( nr, dir[i].d_no ), res );
+		return res;
+	}
+	QMutexLocker lock( &d_dbLock );
+	Udb::Git m = d_post->findCells( writeFreq( nr ) );
+	if( !m.isNull() ) do
+	{
+		// Hier kommen die ItemHits bereits nach OID sortiert.
+		// Zuerst kommt immer der DocHit, gefolgt von allen ItemHits des Doc
+		Udb::OID doc = 0, item = 0;
+		const int n = readKey3( m.getKey(), nr, doc, item );
+		if( n == 2 )
+			res.appendDoc( doc, readFreq( m.getValue() ) );
+		else if( n == 3 && !res.isEmpty() )
+		{
+			Q_ASSERT( res.doc( res.size() - 1 ) == doc );
+			res.appendItem( item, readFreq( m.getValue() ) );
+		}
+	}while( m.nextKey() );
+	return res;
+}
+
+QByteArray IndexEngine::readHeadCell(quint32 tid) const
+{
+	if( !d_post->isOpen() )
+		return QByteArray();
+	QMutexLocker lock( &d_dbLock );
+	return d_post->getCell( writeFreq( tid ) );
+}
+
+QByteArray IndexEngine::readBlockCell(quint32 tid, quint32 no) const
+{
+	if( !d_post->isOpen() )
+		return QByteArray();
+	QMutexLocker lock( &d_dbLock );
+	return d_post->getCell( writeKey2( tid, no ) );
+}
+
+static bool _higherRank( const IndexEngine::DocHit& lhs, const IndexEngine::DocHit& rhs )
+{
+	return lhs.d_rank > rhs.d_rank || ( lhs.d_rank == rhs.d_rank && lhs.d_doc < rhs.d_doc );
+}
+
+IndexEngine::DocHits IndexEngine::findTop(const QStringList & l, int k, bool docAnd, bool joker, bool partial) const
+{
+	QReadLocker lock( &d_lock );
+	DocHits res;
+	if( k <= 0 )
+		return res;
+	if( docAnd )
+	{
+		// AND ueber den Cursor wie bei cursor(); im Heap bleiben nur die besten k, das schlechteste vorne
+		Cursor* c = cursor( l, true, joker, partial );
+		while( !c->atEnd() )
+		{
+			DocHit h;
+			h.d_doc = c->doc();
+			h.d_rank = c->rank();
+			if( res.size() < k )
+			{
+				res.append( h );
+				std::push_heap( res.begin(), res.end(), _higherRank );
+			}else if( _higherRank( h, res.first() ) )
+			{
+				std::pop_heap( res.begin(), res.end(), _higherRank );
+				res.last() = h;
+				std::push_heap( res.begin(), res.end(), _higherRank );
+			}
+			c->next();
+		}
+		delete c;
+		std::sort( res.begin(), res.end(), _higherRank );
+		return res;
+	}
+	// OR: ein Cursor pro Term-ID wie in findHits
+	QList<TermCursor*> cursors;
+	foreach( const QString& s, l )
+	{
+		QList<quint32> nrs;
+		HitList resolved;
+		if( expandTerm( s, joker, partial, nrs, resolved ) )
+		{
+			foreach( quint32 nr, nrs )
+				cursors.append( new TermCursor( this, nr ) );
+		}else
+			cursors.append( new TermCursor( this, resolved ) );
+	}
+	const QList<TermCursor::Hit> top = TermCursor::topK( cursors, k );
+	qDeleteAll( cursors );
+	for( int i = 0; i < top.size(); i++ )
+	{
+		DocHit h;
+		h.d_doc = top[i].second;
+		h.d_rank = top[i].first;
+		res.append( h );
+	}
+	return res;
+}
+
+bool IndexEngine::expandTerm(const QString & s, bool joker, bool partial, QList<quint32> & nrs, HitList & resolved) const
+{
+	if( !joker || !s.contains( QChar('*') ) )
+	{
+		nrs = termIds( s, partial, false );
+		return true;
+	}
+	QString str = s;
+	if( str.endsWith( QChar('*') ) )
+	{
+		// wie findHitsWithJoker: der Joker kehrt die Wirkung von partial um
+		str.chop( 1 );
+		if( !str.isEmpty() && !str.contains( QChar('*') ) )
+		{
+			nrs = termIds( str, !partial, false );
+			return true;
+		}
+	}
+	// Joker mit Teilen vor und nach '*' werden zuerst aufgeloest und als bewertete Liste eingebracht
+	resolved = findHitsWithJoker( s, true, partial );
+	return false;
+}
+
+Cursor* IndexEngine::cursor(const QString & s, bool partial) const
+{
+	return cursor( QStringList() << s, true, false, partial );
+}
+
+Cursor* IndexEngine::cursor(const QStringList & l, bool docAnd, bool joker, bool partial) const
+{
+	QReadLocker lock( &d_lock );
+	QList<QPair<quint64,int> > order;
+	for( int i = 0; i < l.size(); i++ )
+		order.append( qMakePair( ( docAnd ) ? estimateDocs( l[i], joker, partial ) : 0, i ) );
+	if( docAnd )
+		qSort( order ); // seltenste Begriffe zuerst, wie in findHits
+	QList<Cursor*> subs;
+	for( int k = 0; k < order.size(); k++ )
+	{
+		QList<quint32> nrs;
+		HitList resolved;
+		QList<Cursor*> terms;
+		if( expandTerm( l[order[k].second], joker, partial, nrs, resolved ) )
+		{
+			foreach( quint32 nr, nrs )
+				terms.append( termCursor( nr ) );
+		}else
+			terms.append( new TermCursor( this, resolved ) );
+		if( terms.size() == 1 )
+			subs.append( terms.first() );
+		else
+			subs.append( new OrCursor( terms ) );
+	}
+	if( subs.size() == 1 )
+		return subs.first();
+	if( docAnd )
+		return new AndCursor( subs );
+	else
+		return new OrCursor( subs );
+}
+
+bool IndexEngine::phraseQuery(const QString & phrase, PositionQuery & q) const
+{
+	q.d_phrase = true;
+	q.d_ordered = true;
+	q.d_distance = 0;
+	if( d_tok == 0 )
+		return false;
+	const QStringList tokens = tokenize( phrase );
+	for( int pos = 0; pos < tokens.size(); pos++ )
+	{
+		const QString& t = tokens[pos];
+		if( d_sto == 0 || !d_sto->isStopword( t ) )
+		{
+			// wie termIds, aber ohne Joker
+			const quint32 nr = findStem( stemTerm( t ) );
+			if( nr == 0 )
+				return false;
+			q.d_tids.append( nr );
+			q.d_offsets.append( pos );
+		}
+	}
+	return !q.d_tids.isEmpty();
+}
+
+bool IndexEngine::nearQuery(const QStringList & terms, int distance, bool ordered, PositionQuery & q) const
+{
+	q.d_phrase = false;
+	q.d_ordered = ordered;
+	q.d_distance = qMax( distance, 0 );
+	foreach( const QString& s, terms )
+	{
+		const QString t = s.toLower();
+		if( d_sto != 0 && d_sto->isStopword( t ) )
+			continue;
+		const quint32 nr = findStem( stemTerm( t ) );
+		if( nr == 0 )
+			return false;
+		if( !q.d_tids.contains( nr ) ) // derselbe Term zweimal wuerde dieselbe Position zweimal verwenden
+			q.d_tids.append( nr );
+	}
+	return !q.d_tids.isEmpty();
+}
+
+Cursor* IndexEngine::positionCursor(const PositionQuery & q) const
+{
+	if( d_pos == 0 || q.d_tids.isEmpty() )
+		return new TermCursor( this, HitList() );
+	// Kandidaten aus der Schnittmenge der Terme, seltenste zuerst
+	QList<QPair<quint32,quint32> > order;
+	for( int i = 0; i < q.d_tids.size(); i++ )
+	{
+		bool dup = false;
+		for( int j = 0; j < order.size() && !dup; j++ )
+			dup = order[j].second == q.d_tids[i];
+		if( !dup )
+			order.append( qMakePair( readTermStats( q.d_tids[i] ).d_df, q.d_tids[i] ) );
+	}
+	qSort( order );
+	QList<Cursor*> subs;
+	for( int i = 0; i < order.size(); i++ )
+		subs.append( termCursor( order[i].second ) );
+	Cursor* c = ( subs.size() == 1 ) ? subs.first() : new AndCursor( subs );
+	return new PositionCursor( this, q, c );
+}
+
+IndexEngine::DocHits IndexEngine::findPositions(const PositionQuery & q) const
+{
+	DocHits res;
+	if( d_pos == 0 || q.d_tids.isEmpty() )
+		return res; // positionCursor liefert dann keinen PositionCursor
+	PositionCursor* c = static_cast<PositionCursor*>( positionCursor( q ) );
+	while( !c->atEnd() )
+	{
+		DocHit hit;
+		hit.d_doc = c->doc();
+		hit.d_rank = c->rank();
+		hit.d_items = c->items();
+		res.append( hit );
+		c->next();
+	}
+	delete c;
+	return res;
+}
+
+static quint32 _matchPhrase( const QVector<QVector<quint32> >& pos, const QList<int>& offsets )
+{
+	// Fuer jede Position des ersten Terms muessen die anderen im selben Abstand wie im Suchbegriff stehen
+	quint32 n = 0;
+	QVector<int> at( pos.size(), 0 );
+	const QVector<quint32>& first = pos[0];
+	for( int k = 0; k < first.size(); k++ )
+	{
+		const qint64 base = qint64( first[k] ) - offsets[0];
+		bool ok = true;
+		for( int i = 1; i < pos.size() && ok; i++ )
+		{
+			const qint64 want = base + offsets[i];
+			const QVector<quint32>& p = pos[i];
+			while( at[i] < p.size() && p[at[i]] < want )
+				at[i]++;
+			ok = at[i] < p.size() && p[at[i]] == want;
+		}
+		if( ok )
+			n++;
+	}
+	return n;
+}
+
+static quint32 _matchNear( const QVector<QVector<quint32> >& pos, int distance, bool ordered )
+{
+	// Alle Positionen in Reihenfolge; gezaehlt werden die Positionen, mit denen ein passendes Fenster endet
+	QVector<QPair<quint32,int> > events;
+	for( int i = 0; i < pos.size(); i++ )
+		for( int k = 0; k < pos[i].size(); k++ )
+			events.append( qMakePair( pos[i][k], i ) );
+	qSort( events );
+	const int n = pos.size();
+	QVector<qint64> start( n, -1 ); // ordered: Anfang der juengsten Folge bis Term i; sonst letzte Position von i
+	int seen = 0;
+	quint32 res = 0;
+	for( int e = 0; e < events.size(); e++ )
+	{
+		const qint64 p = events[e].first;
+		const int i = events[e].second;
+		qint64 first = -1;
+		if( ordered )
+		{
+			if( i == 0 )
+				start[0] = p;
+			else if( start[i-1] >= 0 )
+				start[i] = start[i-1];
+			if( i == n - 1 )
+				first = start[i];
+		}else
+		{
+			if( start[i] < 0 )
+				seen++;
+			start[i] = p;
+			if( seen == n )
+				first = *std::min_element( start.begin(), start.end() );
+		}
+		if( first >= 0 && p - first - ( n - 1 ) <= distance )
+			res++;
+	}
+	return res;
+}
+
+quint32 IndexEngine::matchPositions(const PositionQuery & q, Udb::OID doc, ItemHits * items) const
+{
+	// Feld (Item, Attribut) -> Positionen pro Term der Abfrage
+	typedef QPair<Udb::OID,Udb::Atom> Field;
+	QMap<Field,QVector<QVector<quint32> > > fields;
+	for( int i = 0; i < q.d_tids.size(); i++ )
+	{
+		QMutexLocker lock( &d_dbLock );
+		Udb::Git git = d_pos->findCells( writeKey2( q.d_tids[i], doc ) );
+		if( !git.isNull() ) do
+		{
+			Field f;
+			readPosKey( git.getKey(), f.first, f.second );
+			if( q.d_attr != 0 && f.second != q.d_attr )
+				continue;
+			if( i == 0 )
+				fields[f].resize( q.d_tids.size() );
+			else if( !fields.contains( f ) )
+				continue; // hier fehlt bereits ein frueherer Term
+			readPosList( git.getValue(), fields[f][i] );
+		}while( git.nextKey() );
+	}
+	quint32 total = 0;
+	QMap<Udb::OID,quint32> perItem;
+	QMap<Field,QVector<QVector<quint32> > >::const_iterator j;
+	for( j = fields.begin(); j != fields.end(); ++j )
+	{
+		bool complete = true;
+		for( int i = 0; i < j.value().size() && complete; i++ )
+			complete = !j.value()[i].isEmpty();
+		if( !complete )
+			continue;
+		const quint32 n = ( q.d_phrase ) ? _matchPhrase( j.value(), q.d_offsets ) :
+										  _matchNear( j.value(), q.d_distance, q.d_ordered );
+		total += n;
+		if( n != 0 && j.key().first != doc )
+			perItem[j.key().first] += n;
+	}
+	if( items )
+	{
+		QMap<Udb::OID,quint32>::const_iterator k;
+		for( k = perItem.begin(); k != perItem.end(); ++k )
+		{
+			ItemHit hit;
+			hit.d_item = k.key();
+			hit.d_rank = k.value();
+			items->append( hit );
+		}
+	}
+	return total;
+}
+
+IndexEngine::DocHits IndexEngine::findPhrase(const QString & phrase) const
+{
+	QReadLocker lock( &d_lock );
+	PositionQuery q;
+	if( !phraseQuery( phrase, q ) )
+		return DocHits();
+	return findPositions( q );
+}
+
+IndexEngine::DocHits IndexEngine::findNear(const QStringList & terms, int distance, bool ordered) const
+{
+	QReadLocker lock( &d_lock );
+	PositionQuery q;
+	if( !nearQuery( terms, distance, ordered, q ) )
+		return DocHits();
+	return findPositions( q );
+}
+
+Cursor* IndexEngine::phraseCursor(const QString & phrase) const
+{
+	QReadLocker lock( &d_lock );
+	PositionQuery q;
+	if( !phraseQuery( phrase, q ) )
+		q.d_tids.clear();
+	return positionCursor( q );
+}
+
+Cursor* IndexEngine::nearCursor(const QStringList & terms, int distance, bool ordered) const
+{
+	QReadLocker lock( &d_lock );
+	PositionQuery q;
+	if( !nearQuery( terms, distance, ordered, q ) )
+		q.d_tids.clear();
+	return positionCursor( q );
+}
+
+Cursor* IndexEngine::termCursor(quint32 tid) const
+{
+	if( d_format == BlockFormat )
+		return new TermCursor( this, tid );
+	else
+		return new PostingCursor( this, tid );
+}
+
+void IndexEngine::addQueryField(const QString & name, Udb::Atom attr)
+{
+	QWriteLocker lock( &d_lock );
+	d_queryFields[name.toLower()] = attr;
+}
+
+IndexEngine::DocHits IndexEngine::findQuery(const QString & str) const
+{
+	QReadLocker lock( &d_lock );
+	DocHits res;
+	Cursor* c = queryCursor( str );
+	while( !c->atEnd() )
+	{
+		DocHit hit;
+		hit.d_doc = c->doc();
+		hit.d_rank = c->rank();
+		res.append( hit );
+		c->next();
+	}
+	delete c;
+	return res;
+}
+
+Cursor* IndexEngine::queryCursor(const QString & str) const
+{
+	QReadLocker lock( &d_lock );
+	Query q;
+	if( !q.parse( str, d_queryFields ) )
+	{
+		qWarning() << "IndexEngine::findQuery:" << q.getError() << "in" << str;
+		return new TermCursor( this, HitList() );
+	}
+	QueryPlan p;
+	if( q.getRoot() == 0 || planQuery( q.getRoot(), p ) != PlanOk )
+		return new TermCursor( this, HitList() );
+	return compileQuery( p );
+}
+
+QList<quint32> IndexEngine::queryTermIds(const QString & s) const
+{
+	// Praefix und Suffix wie findHitsWithJoker, alle anderen Muster mit dem Automaten, damit auch sie
+	// auf Term-IDs und damit auf Cursor abgebildet werden
+	const int stars = s.count( QChar('*') );
+	if( !s.contains( QChar('?') ) )
+	{
+		if( stars == 0 || ( stars == 1 && s.size() > 1 && s.endsWith( QChar('*') ) ) )
+			return termIds( s, false, false );
+		if( stars == 1 && s.size() > 1 && s.startsWith( QChar('*') ) && d_useReverseIndex )
+			return termIds( s.mid( 1 ), true, true );
+	}
+	const PatternAutomaton a( s, PatternAutomaton::Glob );
+	if( !a.isValid() )
+	{
+		qWarning() << "IndexEngine::findQuery: invalid pattern:" << s << a.getError();
+		return QList<quint32>();
+	}
+	return automatonIds( a );
+}
+
+IndexEngine::PlanResult IndexEngine::planQuery(const QueryNode * n, QueryPlan & p) const
+{
+	p.d_op = n->d_op;
+	switch( n->d_op )
+	{
+	case QueryNode::Term:
+		{
+			const QString s = n->d_text.toLower();
+			if( d_sto != 0 && !s.contains( QChar('*') ) && !s.contains( QChar('?') ) && d_sto->isStopword( s ) )
+				return PlanIgnored;
+			p.d_tids = queryTermIds( s );
+			foreach( quint32 nr, p.d_tids )
+				p.d_cost += readTermStats( nr ).d_df;
+			p.d_query.d_attr = n->d_field;
+			return ( p.d_tids.isEmpty() ) ? PlanEmpty : PlanOk;
+		}
+	case QueryNode::Phrase:
+	case QueryNode::Near:
+		{
+			bool ok = false;
+			if( n->d_op == QueryNode::Phrase )
+				ok = phraseQuery( n->d_text, p.d_query );
+			else if( d_tok != 0 )
+				ok = nearQuery( tokenize( n->d_text ), n->d_distance, false, p.d_query );
+			if( !ok )
+				return PlanEmpty;
+			p.d_query.d_attr = n->d_field;
+			// hoechstens so viele Docs wie der seltenste Term
+			p.d_cost = std::numeric_limits<quint64>::max();
+			foreach( quint32 nr, p.d_query.d_tids )
+				p.d_cost = qMin( p.d_cost, quint64( readTermStats( nr ).d_df ) );
+			return PlanOk;
+		}
+	case QueryNode::And:
+		{
+			QList<QueryPlan> subs;
+			QList<QPair<quint64,int> > order;
+			foreach( const QueryNode* s, n->d_subs )
+			{
+				const bool negative = s->d_op == QueryNode::Not;
+				QueryPlan sub;
+				const PlanResult r = planQuery( ( negative ) ? s->d_subs.first() : s, sub );
+				if( negative )
+				{
+					if( r == PlanOk ) // ein leerer NOT-Teil schliesst nichts aus
+						p.d_excluded.append( sub );
+				}else if( r == PlanEmpty )
+					return PlanEmpty; // die uebrigen Teile muessen gar nicht erst aufgeloest werden
+				else if( r == PlanOk )
+				{
+					order.append( qMakePair( sub.d_cost, subs.size() ) );
+					subs.append( sub );
+				}
+			}
+			if( subs.isEmpty() )
+				return PlanIgnored;
+			qSort( order ); // seltenste Teile zuerst, sie geben in AndCursor die Kandidaten vor
+			for( int i = 0; i < order.size(); i++ )
+				p.d_subs.append( subs[order[i].second] );
+			p.d_cost = order.first().first;
+			if( p.d_subs.size() == 1 && p.d_excluded.isEmpty() )
+			{
+				const QueryPlan sub = p.d_subs.first();
+				p = sub;
+			}
+			return PlanOk;
+		}
+	case QueryNode::Or:
+		{
+			int ignored = 0;
+			foreach( const QueryNode* s, n->d_subs )
+			{
+				QueryPlan sub;
+				const PlanResult r = planQuery( s, sub );
+				if( r == PlanOk )
+				{
+					p.d_cost += sub.d_cost;
+					p.d_subs.append( sub );
+				}else if( r == PlanIgnored )
+					ignored++;
+			}
+			if( p.d_subs.isEmpty() ) // nur wenn alle Teile Stoppwoerter sind, faellt das OR ganz weg
+				return ( ignored == n->d_subs.size() ) ? PlanIgnored : PlanEmpty;
+			if( p.d_subs.size() == 1 )
+			{
+				const QueryPlan sub = p.d_subs.first();
+				p = sub;
+			}
+			return PlanOk;
+		}
+	default:
+		return PlanEmpty; // NOT steht nach Query::parse nur in einer Konjunktion
+	}
+}
+
+Cursor* IndexEngine::compileQuery(const QueryPlan & p) const
+{
+	QList<Cursor*> subs;
+	switch( p.d_op )
+	{
+	case QueryNode::Term:
+		foreach( quint32 nr, p.d_tids )
+		{
+			if( p.d_query.d_attr == 0 )
+				subs.append( termCursor( nr ) );
+			else
+			{
+				// jedes Vorkommen im Feld ist ein Treffer
+				PositionQuery q = p.d_query;
+				q.d_tids.append( nr );
+				subs.append( positionCursor( q ) );
+			}
+		}
+		break;
+	case QueryNode::Phrase:
+	case QueryNode::Near:
+		return positionCursor( p.d_query );
+	case QueryNode::And:
+	case QueryNode::Or:
+		foreach( const QueryPlan& s, p.d_subs )
+			subs.append( compileQuery( s ) );
+		break;
+	}
+	Cursor* res = 0;
+	if( subs.isEmpty() )
+		res = new TermCursor( this, HitList() );
+	else if( subs.size() == 1 )
+		res = subs.first();
+	else if( p.d_op == QueryNode::And )
+		res = new AndCursor( subs );
+	else
+		res = new OrCursor( subs );
+	if( !p.d_excluded.isEmpty() )
+	{
+		QList<Cursor*> excluded;
+		foreach( const QueryPlan& s, p.d_excluded )
+			excluded.append( compileQuery( s ) );
+		res = new AndNotCursor( res, ( excluded.size() == 1 ) ? excluded.first() : new OrCursor( excluded ) );
+	}
+	return res;
+}
+
+Udb::Git IndexEngine::findPostings(quint32 tid) const
+{
+	// der Aufrufer haelt d_dbLock
+	return d_post->findCells( writeFreq( tid ) );
+}
+
+Udb::Git IndexEngine::findLengths() const
+{
+	// die Laengen bleiben auch im BlockFormat einzelne Zellen wie im RowFormat
+	return findPostings( s_lengthTerm );
+}
+
+quint32 IndexEngine::readDocLength(Udb::OID doc) const
+{
+	return readFreq( d_post->getCell( writeKey2( s_lengthTerm, doc ) ) );
+}
+
+int IndexEngine::readPostingKey(const QByteArray & key, quint32 & tid, Udb::OID & doc, Udb::OID & item)
+{
+	return readKey3( key, tid, doc, item );
+}
+
+quint32 IndexEngine::readPostingFreq(const QByteArray & value)
+{
+	return readFreq( value );
+}
+
+void IndexEngine::setScoring(IndexEngine::Scoring s, float k1, float b)
+{
+	QWriteLocker lock( &d_lock );
+	d_scoring = s;
+	d_k1 = k1;
+	d_b = b;
+	d_indexGen++;
+}
+
+quint32 IndexEngine::getDocLength(Udb::OID doc) const
+{
+	if( !d_post->isOpen() )
+		return 0;
+	QReadLocker lock( &d_lock );
+	QMutexLocker db( &d_dbLock );
+	return readDocLength( doc );
+}
+
+quint32 IndexEngine::getDocCount() const
+{
+	if( !d_post->isOpen() )
+		return 0;
+	QReadLocker lock( &d_lock );
+	QMutexLocker db( &d_dbLock );
+	return readStats( d_post->getCell( writeFreq( s_lengthTerm ) ) ).d_df;
+}
+
+quint64 IndexEngine::getTotalLength() const
+{
+	if( !d_post->isOpen() )
+		return 0;
+	QReadLocker lock( &d_lock );
+	QMutexLocker db( &d_dbLock );
+	return readStats( d_post->getCell( writeFreq( s_lengthTerm ) ) ).d_ttf;
+}
+
+HitList IndexEngine::findHits(const QStringList & l, bool docAnd, bool itemAnd, bool joker, bool partial) const
+{
+	QReadLocker lock( &d_lock );
+	if( d_resultLimit == 0 )
+		return evalHits( l, docAnd, itemAnd, joker, partial );
+	const QString key = resultKey( l, docAnd, itemAnd, joker, partial );
+	QMutexLocker cache( &d_cacheLock );
+	if( d_resultGen != d_indexGen )
+	{
+		// Index hat sich geaendert
+		trimResultCache( 0 );
+		d_resultGen = d_indexGen;
+	}
+	QHash<QString,CachedResult>::iterator i = d_results.find( key );
+	if( i != d_results.end() )
+	{
+		d_resultHits++;
+		d_resultLru.remove( i.value().d_tick );
+		i.value().d_tick = ++d_resultTick;
+		d_resultLru.insert( i.value().d_tick, key );
+		return *i.value().d_hits;
+	}
+	d_resultMisses++;
+	cache.unlock(); // die anderen Abfragen warten nicht auf die Auswertung
+	const HitList res = evalHits( l, docAnd, itemAnd, joker, partial );
+	CachedResult r;
+	r.d_bytes = res.size() * ( sizeof(Udb::OID) + sizeof(quint32) + sizeof(int) ) +
+			res.itemCount() * ( sizeof(Udb::OID) + sizeof(quint32) ) + key.size() * sizeof(QChar) + s_termOverhead;
+	if( r.d_bytes > d_resultLimit )
+		return res;
+	cache.relock();
+	if( d_results.contains( key ) )
+		return res; // inzwischen von einer anderen Abfrage eingetragen
+	trimResultCache( d_resultLimit - r.d_bytes );
+	r.d_hits = new HitList( res );
+	r.d_tick = ++d_resultTick;
+	d_results.insert( key, r );
+	d_resultLru.insert( r.d_tick, key );
+	d_resultSize += r.d_bytes;
+	return res;
+}
+
+QString IndexEngine::resultKey(const QStringList & l, bool docAnd, bool itemAnd, bool joker, bool partial) const
+{
+	// AND und OR haengen nicht von der Reihenfolge der Begriffe ab
+	QStringList terms;
+	foreach( const QString& s, l )
+	{
+		QString t = s.toLower();
+		if( !t.contains( QChar('*') ) && !t.contains( QChar('?') ) && !t.endsWith( QChar('!') ) )
+			t = stemTerm( t ); // wie termIds
+		terms.append( t );
+	}
+	terms.sort();
+	QString key;
+	key += QChar( ( docAnd ) ? 'A' : 'O' );
+	key += QChar( ( itemAnd ) ? 'A' : 'O' );
+	key += QChar( ( joker ) ? 'J' : '-' );
+	key += QChar( ( partial ) ? 'P' : '-' );
+	foreach( const QString& t, terms )
+	{
+		key += QChar( 0 );
+		key += t;
+	}
+	return key;
+}
+
+void IndexEngine::trimResultCache(quint32 limit) const
+{
+	// der Aufrufer haelt d_cacheLock
+	while( d_resultSize > limit && !d_resultLru.isEmpty() )
+	{
+		QMap<quint64,QString>::iterator i = d_resultLru.begin();
+		const CachedResult r = d_results.take( i.value() );
+		d_resultLru.erase( i );
+		d_resultSize -= r.d_bytes;
+		delete r.d_hits;
+	}
+}
+
+void IndexEngine::setResultCacheLimit(quint32 bytes)
+{
+	QWriteLocker lock( &d_lock );
+	QMutexLocker cache( &d_cacheLock );
+	d_resultLimit = bytes;
+	trimResultCache( bytes );
+}
+
+void IndexEngine::clearResultCache()
+{
+	QMutexLocker lock( &d_cacheLock );
+	trimResultCache( 0 );
+}
+
+void IndexEngine::setPostingCacheLimit(quint32 bytes)
+{
+	QMutexLocker lock( &d_cacheLock );
+	d_postCache->setLimit( bytes );
+}
+
+quint32 IndexEngine::getPostingCacheLimit() const
+{
+	QMutexLocker lock( &d_cacheLock );
+	return d_postCache->getLimit();
+}
+
+void IndexEngine::clearPostingCache()
+{
+	QMutexLocker lock( &d_cacheLock );
+	d_postCache->clear();
+}
+
+HitList IndexEngine::evalHits(const QStringList & l, bool docAnd, bool itemAnd, bool joker, bool partial) const
+{
+	HitList res;
+	if( docAnd )
+	{
+		// AND: seltenste Begriffe zuerst, damit das Zwischenresultat klein bleibt; ist es leer, sind wir fertig.
+		// Die Schaetzung bestimmt nur die Reihenfolge, das Resultat haengt nicht davon ab.
+		QList<QPair<quint64,int> > order;
+		for( int i = 0; i < l.size(); i++ )
+			order.append( qMakePair( estimateDocs( l[i], joker, partial ), i ) );
+		qSort( order );
+		for( int k = 0; k < order.size(); k++ )
+		{
+			const QString& s = l[order[k].second];
+			if( k == 0 )
+				res = (joker)?findHitsWithJoker(s,itemAnd,partial):findHits( s, partial );
+			else
+				res = HitList::intersect( res, (joker)?findHitsWithJoker(s,itemAnd,partial):findHits( s, partial ), !itemAnd );
+			if( res.isEmpty() )
+				break;
+		}
+	}else
+	{
+		// OR
+		QList<HitList> lists;
+		foreach( const QString& s, l )
+			lists.append( (joker)?findHitsWithJoker(s,itemAnd,partial):findHits( s, partial ) );
+		res = HitList::unite( lists, !itemAnd );
+	}
+	return res;
+}
+
+void IndexEngine::commit(bool force)
+{
+	QWriteLocker lock( &d_lock );
+	if( !d_dict->isOpen() )
+		return;
+	flushBulk();
+	d_indexGen++;
+	d_dict->commit();
+	d_post->commit();
+	if( d_queue )
+		d_queue->commit();
+	if( d_tri )
+		d_tri->commit();
+	if( d_delta )
+		d_delta->commit();
+	if( d_pos )
+		d_pos->commit();
+	if( force || d_index.getTxn() != d_txn )
+	{
+		d_index.commit();
+	}
+	if( d_terms && d_termRebuild != 0 && d_deltaCount >= d_termRebuild && !d_rebuildScheduled )
+	{
+		// Nicht hier, da commit auch aus onDbUpdate mitten im Commit der Daten kommt
+		d_rebuildScheduled = true;
+		QTimer::singleShot( 0, this, SLOT(onRebuild()) );
+	}
+}
+
+void IndexEngine::onRebuild()
+{
+	QWriteLocker lock( &d_lock );
+	d_rebuildScheduled = false;
+	if( d_terms && d_termRebuild != 0 && d_deltaCount >= d_termRebuild )
+		writeTermFile( d_terms->getPath() );
+}
+
+bool IndexEngine::writeTermFile(const QString & path)
+{
+	QWriteLocker lock( &d_lock );
+	if( !d_dict->isOpen() || d_index.getTxn()->isReadOnly() )
+		return false;
+	flushBulk();
+	QList<TermFile::Entry> entries;
+	Udb::Git git = d_dict->findCells( QByteArray() );
+	if( !git.isNull() ) do
+	{
+		TermFile::Entry e;
+		e.d_key = git.getKey();
+		e.d_tid = readFreq( git.getValue() );
+		e.d_df = ( !e.d_key.isEmpty() && e.d_key[0] == s_rev ) ? 0 : readTermStats( e.d_tid ).d_df;
+		entries.append( e );
+	}while( git.nextKey() );
+	// Unter Windows kann eine gemappte Datei nicht ersetzt werden
+	const QString old = ( d_terms ) ? d_terms->getPath() : QString();
+	detachTermFile();
+	const quint32 snapshot = d_index.getValue(AttrTermFile).getUInt32() + 1;
+	if( !TermFile::write( path, snapshot, entries ) )
+	{
+		if( !old.isEmpty() )
+			attachTermFile( old );
+		return false;
+	}
+	if( d_delta == 0 )
+	{
+		d_delta = new Udb::Global( d_index.getDb(), this );
+		d_index.setValue(AttrDelta, Stream::DataCell().setId32( d_delta->create() ) );
+	}else
+		d_delta->clearAllCells();
+	d_deltaCount = 0;
+	d_index.setValue(AttrTermFile, Stream::DataCell().setUInt32( snapshot ) );
+	commit(); // teilt der Index die Txn der Daten, kommt AttrTermFile erst mit deren naechstem Commit in die Db
+	return attachTermFile( path );
+}
+
+bool IndexEngine::attachTermFile(const QString & path)
+{
+	QWriteLocker lock( &d_lock );
+	detachTermFile();
+	if( d_delta == 0 )
+	{
+		qWarning() << "IndexEngine::attachTermFile: no term file written for this index";
+		return false;
+	}
+	TermFile* f = new TermFile();
+	if( !f->open( path ) )
+	{
+		delete f;
+		return false;
+	}
+	if( f->getSnapshot() != d_index.getValue(AttrTermFile).getUInt32() )
+	{
+		qWarning() << "IndexEngine::attachTermFile: file does not match the index" << path;
+		delete f;
+		return false;
+	}
+	d_terms = f;
+	d_dictGen++; // df in den Expansionen stammt jetzt aus der Datei
+	return true;
+}
+
+void IndexEngine::detachTermFile()
+{
+	QWriteLocker lock( &d_lock );
+	if( d_terms == 0 )
+		return;
+	delete d_terms;
+	d_terms = 0;
+	d_dictGen++;
+}
+
+void IndexEngine::clearIndex()
+{
+	Q_ASSERT( !holdsReader() ); // siehe Reader
+	QWriteLocker lock( &d_lock );
+	if( !d_dict->isOpen() )
+		return;
+	d_pending.clear();
+	d_pendingSize = 0;
+	d_statDeltas.clear();
+	clearTermCache();
+	d_dictGen++;
+	d_indexGen++;
+	d_postCache->clear();
+	d_nextTerm = d_lastTerm = 0;
+	d_dict->clearAllCells();
+	d_post->clearAllCells();
+	if( d_queue )
+		d_queue->clearAllCells(); // nach clearIndex wird ohnehin neu indiziert
+	if( d_tri )
+		d_tri->clearAllCells();
+	if( d_pos )
+		d_pos->clearAllCells();
+	if( d_delta )
+	{
+		// Eine vorhandene Datei passt nicht mehr; erst nach dem naechsten writeTermFile wieder verwenden
+		detachTermFile();
+		d_delta->clearAllCells();
+		d_deltaCount = 0;
+		d_index.setValue(AttrTermFile, Stream::DataCell().setUInt32(
+							 d_index.getValue(AttrTermFile).getUInt32() + 1 ) );
+	}
+	d_queued.clear();
+	d_queueCount = 0;
+	d_index.clearValue(AttrMaxTerm);
+	d_index.commit();
+}
+
+bool IndexEngine::isEmpty() const
+{
+	QReadLocker lock( &d_lock );
+	return !hasTerms();
+}
+
+bool IndexEngine::hasTerms() const
+{
+	QMutexLocker lock( &d_dbLock );
+	return d_index.getValue(AttrMaxTerm).getUInt32() != 0;
+}
+
+void IndexEngine::addReader( bool add ) const
+{
+#ifndef QT_NO_DEBUG
+	QMutexLocker lock( &d_readerLock );
+	if( add )
+		d_readers.append( QThread::currentThreadId() );
+	else
+		d_readers.removeOne( QThread::currentThreadId() );
+#else
+	Q_UNUSED( add );
+#endif
+}
+
+bool IndexEngine::holdsReader() const
+{
+	QMutexLocker lock( &d_readerLock );
+	return d_readers.contains( QThread::currentThreadId() );
+}
+
+static QString _kb( quint32 b )
+{
+	return QLocale::c().toString( b / 1024.0, 'f', 1 );
+}
+
+void IndexEngine::test() const
+{
+	QReadLocker lock( &d_lock );
+	QMutexLocker db( &d_dbLock );
+	quint32 mkSize = 0, mvSize = 0, mCount = 0;
+	Udb::Git mCur = d_post->findCells( QByteArray() );
+	if( !mCur.isNull() ) do
+	{
+		const QByteArray k = mCur.getKey();
+		mkSize += k.size();
+		mvSize += mCur.getValue().size();
+		mCount++;
+	}while( mCur.nextKey() );
+	qDebug() << "MapTable:" << mCount << _kb(mkSize) << _kb(mvSize);
+	quint32 xkSize = 0, xvSize = 0, xCount = 0;
+	Udb::Git xCur = d_dict->findCells( QByteArray() );
+	if( !xCur.isNull() ) do
+	{
+		const QByteArray k = xCur.getKey();
+		qDebug() << k;
+		xkSize += k.size();
+		xvSize += xCur.getValue().size();
+		xCount++;
+	}while( xCur.nextKey() );
+	//qDebug() << "OixTable:" << xCount << _kb(xkSize) << _kb(xvSize);
+	//qDebug() << "Total (KB):" << _kb(mkSize+xkSize) << _kb(mvSize+xvSize) << _kb(mkSize+xkSize+mvSize+xvSize);
+}
+
+IndexEngine *IndexEngine::getIndex(Udb::Transaction * txn)
+{
+	QMutexLocker lock( &s_cacheLock );
+	return s_cache.value( txn );
+}
+
+void IndexEngine::onDbUpdate(const Udb::UpdateInfo & info)
+{
+	if( info.d_kind != Udb::UpdateInfo::PreCommit )
+		return;
+	Q_ASSERT( !holdsReader() ); // wuerde auf sich selber warten, siehe Reader
+	QWriteLocker lock( &d_lock );
+	if( d_checkEmpty && !hasTerms() )
+		return;
+	if( !d_async )
+		drainAll(); // Eintraege aus einer frueheren Sitzung zuerst, siehe setAsync
+	Udb::Transaction::Changes::const_iterator i;
+	Udb::Obj o;
+	bool erased = false;
+	bool toProcess = false;
+	bool changes = false;
+	quint32 ticket = 0;
+	beginBulk(); // Postings, Laengen und Statistik nur einmal pro Schluessel schreiben
+	for( i = d_txn->getChanges().begin(); i != d_txn->getChanges().end(); ++i )
+	{
+		if( i.key().first != o.getOid() )
+		{
+			erased = ( i.key().second == 0 && i.value().isNull() );
+			o = d_txn->getObject( i.key().first );
+			toProcess = d_typesToWatch.isEmpty() || d_typesToWatch.contains( o.getType() );
+			if( o.equals( d_index ) )
+				toProcess = false;
+		}
+		if( toProcess && d_async && ticket == 0 && ( erased || d_attrsToWatch.contains( i.key().second ) ) )
+		{
+			ticket = d_index.incCounter( AttrTicket );
+			d_lastTicket = ticket;
+		}
+		if( toProcess )
+		{
+			if( erased )
+			{
+				QSet<Udb::Atom>::const_iterator j;
+				for( j = d_attrsToWatch.begin(); j != d_attrsToWatch.end(); ++j )
+				{
+					if( d_async )
+						enqueue( o, (*j), ticket );
+					else
+					{
+						process( o.getValue( (*j), true ), o, true );
+						indexPositions( o, (*j), o.getValue( (*j), true ).toString(true), QString() );
+					}
+					changes = true;
+				}
+			}else if( d_attrsToWatch.contains( i.key().second ) )
+			{
+				if( d_async )
+					enqueue( o, i.key().second, ticket );
+				else
+				{
+					const Stream::DataCell oldValue = o.getValue( i.key().second, true );
+					const Stream::DataCell newValue = o.getValue( i.key().second, false );
+					processChange( oldValue, newValue, o );
+					indexPositions( o, i.key().second, oldValue.toString(true), newValue.toString(true) );
+				}
+				changes = true;
+			}
+		}
+	}
+	endBulk();
+	if( changes )
+		commit();
+	if( changes && d_async && !d_drainScheduled )
+	{
+		d_drainScheduled = true;
+		QTimer::singleShot( 0, this, SLOT(onDrain()) );
+	}
+}
+
+void IndexEngine::index(const QString & s, const Udb::Obj & o, bool remove)
+{
+	const quint32 tid = termId(s,true);
+
+	Udb::Obj doc;
+	if( d_resolveDocuments )
+		doc = getDocument(o);
+	if( doc.isNull() )
+		doc = o;
+
+	const qint32 delta = ( remove ) ? -1 : 1;
+	addPosting( writeKey2( tid, doc.getOid() ), delta ); // term, oid -> freq
+	addPosting( writeKey2( s_lengthTerm, doc.getOid() ), delta ); // Laenge des Docs
+	if( d_resolveDocuments && !doc.equals(o) )
+		addPosting( writeKey3( tid, doc.getOid(), o.getOid() ), delta ); // term, doc, item -> freq
+}
+
+void IndexEngine::applyTerms(const Terms & terms, const Udb::Obj & o)
+{
+	Udb::Obj doc;
+	if( d_resolveDocuments )
+		doc = getDocument(o);
+	if( doc.isNull() )
+		doc = o;
+	const bool items = d_resolveDocuments && !doc.equals(o);
+
+	qint32 length = 0;
+	Terms::const_iterator i;
+	for( i = terms.begin(); i != terms.end(); ++i )
+	{
+		const Term& t = i.value();
+		if( t.d_freq == 0 && t.d_raw.isEmpty() )
+			continue;
+		const quint32 tid = stemId( i.key(), t.d_freq > 0 || !t.d_raw.isEmpty() );
+		if( tid == 0 )
+			continue; // Term war nie im Index, also gibt es auch nichts zu entfernen
+		if( d_useReverseIndex )
+		{
+			foreach( const QString& raw, t.d_raw )
+				writeReverse( raw, tid );
+		}
+		if( d_useTrigramIndex )
+		{
+			foreach( const QString& raw, t.d_raw )
+				writeTrigrams( raw, tid );
+		}
+		if( t.d_freq == 0 )
+			continue;
+		addPosting( writeKey2( tid, doc.getOid() ), t.d_freq );
+		if( items )
+			addPosting( writeKey3( tid, doc.getOid(), o.getOid() ), t.d_freq );
+		length += t.d_freq;
+	}
+	if( length != 0 )
+		addPosting( writeKey2( s_lengthTerm, doc.getOid() ), length );
+}
+
+void IndexEngine::addPosting(const QByteArray & key, qint32 delta)
+{
+	if( d_bulkLevel == 0 )
+	{
+		writePosting( key, delta );
+		flushStats();
+		return;
+	}
+	QHash<QByteArray,qint32>::iterator i = d_pending.find( key );
+	if( i != d_pending.end() )
+	{
+		i.value() += delta;
+		return;
+	}
+	d_pending.insert( key, delta );
+	d_pendingSize += key.size() + s_pendingOverhead;
+	if( d_bulkLimit != 0 && d_pendingSize > d_bulkLimit )
+		flushBulk(); // Zwischenflush, Bulk-Modus bleibt aktiv
+}
+
+void IndexEngine::writePosting(const QByteArray & key, qint32 delta)
+{
+	d_indexGen++;
+	d_postCache->remove( readFreq( key ) );
+	// Die Laengen bleiben auch im BlockFormat einzelne Zellen, da sie pro Doc gelesen werden
+	if( d_format == BlockFormat && readFreq( key ) != s_lengthTerm )
+	{
+		QVector<Delta> deltas;
+		deltas.append( qMakePair( key, delta ) );
+		writeBlockDeltas( readFreq( key ), deltas, 0, 1 );
+		return;
+	}
+	const qint64 old = readFreq( d_post->getCell( key ) );
+	qint64 freq = old + delta;
+	if( freq > std::numeric_limits<qint32>::max() )
+	{
+		qWarning() << "IndexEngine::index: frequency out of qint32 range";
+		freq = std::numeric_limits<qint32>::max();
+	}
+	if( freq > 0 )
+		d_post->setCell( key, writeFreq(freq) );
+	else
+	{
+		d_post->setCell( key, QByteArray() ); // loeschen
+		freq = 0;
+	}
+	quint32 tid;
+	Udb::OID doc, item;
+	if( freq != old && readKey3( key, tid, doc, item ) == 2 )
+	{
+		// Nur die Doc-Ebene zaehlt fuer die Statistik; geschrieben wird sie in flushStats
+		QPair<qint32,qint64>& s = d_statDeltas[tid];
+		s.first += ( freq > 0 ) - ( old > 0 );
+		s.second += freq - old;
+	}
+}
+
+void IndexEngine::flushStats()
+{
+	QHash<quint32,QPair<qint32,qint64> >::const_iterator i;
+	for( i = d_statDeltas.begin(); i != d_statDeltas.end(); ++i )
+	{
+		if( i.value().first == 0 && i.value().second == 0 )
+			continue;
+		const QByteArray key = writeFreq( i.key() );
+		const TermStats old = readStats( d_post->getCell( key ) );
+		const qint64 df = qint64(old.d_df) + i.value().first;
+		const qint64 ttf = qint64(old.d_ttf) + i.value().second;
+		if( df > 0 )
+			d_post->setCell( key, writeStats( df, qMax( ttf, qint64(0) ) ) );
+		else
+			d_post->setCell( key, QByteArray() );
+	}
+	d_statDeltas.clear();
+}
+
+static qint64 _applyDeltas( IndexEngine::DocHits& docs, const QVector<IndexEngine::Delta>& deltas, int from, int to )
+{
+	// Fuehrt die nach Schluessel sortierten Deltas mit den nach OID sortierten docs zusammen;
+	// gibt die Aenderung der Summe der Doc-Haeufigkeiten zurueck
+	qint64 ttf = 0;
+	IndexEngine::DocHits res;
+	res.reserve( docs.size() + to - from );
+	int i = 0;
+	int d = from;
+	while( i < docs.size() || d < to )
+	{
+		quint32 nr = 0;
+		Udb::OID doc = 0, item = 0;
+		if( d < to )
+			readKey3( deltas[d].first, nr, doc, item );
+		if( d >= to || ( i < docs.size() && docs[i].d_doc < doc ) )
+		{
+			res.append( docs[i++] );
+			continue;
+		}
+		IndexEngine::DocHit hit;
+		if( i < docs.size() && docs[i].d_doc == doc )
+			hit = docs[i++];
+		else
+		{
+			hit.d_doc = doc;
+			hit.d_rank = 0;
+		}
+		qint64 freq = hit.d_rank;
+		const qint64 old = freq;
+		IndexEngine::ItemHits items;
+		int k = 0;
+		while( d < to )
+		{
+			const int n = readKey3( deltas[d].first, nr, doc, item );
+			if( doc != hit.d_doc )
+				break;
+			if( n == 2 )
+				freq += deltas[d].second;
+			else if( n == 3 )
+			{
+				while( k < hit.d_items.size() && hit.d_items[k].d_item < item )
+					items.append( hit.d_items[k++] );
+				qint64 f = deltas[d].second;
+				if( k < hit.d_items.size() && hit.d_items[k].d_item == item )
+					f += hit.d_items[k++].d_rank;
+				if( f > 0 )
+				{
+					IndexEngine::ItemHit h;
+					h.d_item = item;
+					h.d_rank = qMin( f, qint64(std::numeric_limits<qint32>::max()) );
+					items.append( h );
+				}
+			}
+			d++;
+		}
+		while( k < hit.d_items.size() )
+			items.append( hit.d_items[k++] );
+		if( freq > 0 )
+		{
+			hit.d_rank = qMin( freq, qint64(std::numeric_limits<qint32>::max()) );
+			hit.d_items = items;
+			res.append( hit );
+			ttf += hit.d_rank - old;
+		}else
+			ttf -= old;
+	}
+	docs = res;
+	return ttf;
+}
+
+static PostingCodec::BlockDir _writeBlocks( Udb::Global* post, quint32 tid, const PostingCodec::BlockDir& blocks,
+											const QVector<IndexEngine::Delta>& deltas, int from, int to,
+											quint32& nextNo, qint64& ttf )
+{
+	// Nur die Bloecke, in welche die Deltas fallen, werden gelesen und neu geschrieben; die Blockzellen
+	// verwenden dasselbe Schluesselformat wie key2, aber mit der Blocknummer anstelle der OID.
+	PostingCodec::BlockDir dir;
+	int d = from;
+	int b = 0;
+	while( b < blocks.size() || d < to )
+	{
+		quint32 no = 0;
+		IndexEngine::DocHits docs;
+		if( b < blocks.size() )
+		{
+			const PostingCodec::BlockRef ref = blocks[b++];
+			const bool last = ( b == blocks.size() );
+			int e = d;
+			quint32 nr;
+			Udb::OID doc = 0, item = 0;
+			while( e < to && ( last || ( readKey3( deltas[e].first, nr, doc, item ) > 0 && doc <= ref.d_last ) ) )
+				e++;
+			if( e == d )
+			{
+				dir.append( ref );
+				continue;
+			}
+			no = ref.d_no;
+			PostingCodec::readBlock( post->getCell( writeKey2( tid, no ) ), docs );
+			ttf += _applyDeltas( docs, deltas, d, e );
+			d = e;
+		}else
+		{
+			no = nextNo++;
+			ttf += _applyDeltas( docs, deltas, d, to );
+			d = to;
+		}
+		if( docs.isEmpty() )
+		{
+			post->setCell( writeKey2( tid, no ), QByteArray() ); // loeschen
+			continue;
+		}
+		// zu grosse Bloecke werden geteilt
+		const int n = ( docs.size() > PostingCodec::MaxBlock ) ? int(PostingCodec::BlockSize) : docs.size();
+		for( int i = 0; i < docs.size(); i += n )
+		{
+			const int j = qMin( i + n, docs.size() );
+			if( i > 0 )
+				no = nextNo++;
+			post->setCell( writeKey2( tid, no ), PostingCodec::writeBlock( docs, i, j ) );
+			dir.append( PostingCodec::makeRef( docs, i, j, no ) );
+		}
+	}
+	return dir;
+}
+
+void IndexEngine::writeBlockDeltas(quint32 tid, const QVector<Delta> & deltas, int from, int to)
+{
+	// Wie die Bloecke in _writeBlocks werden auch nur die Seiten des Verzeichnisses gelesen und neu
+	// geschrieben, in welche die Deltas fallen; der Kopf wird immer geschrieben.
+	d_indexGen++;
+	d_postCache->remove( tid );
+	const QByteArray headKey = writeFreq( tid );
+	PostingCodec::Head head;
+	PostingCodec::readHead( d_post->getCell( headKey ), head );
+	if( !head.d_blocks.isEmpty() )
+		head.d_pages.append( PostingCodec::makePage( head.d_blocks, 0, head.d_blocks.size(), 0 ) ); // aelterer Kopf
+	PostingCodec::PageDir pages;
+	qint64 ttf = head.d_ttf;
+	int d = from;
+	int p = 0;
+	while( p < head.d_pages.size() || d < to )
+	{
+		quint32 no = 0;
+		PostingCodec::BlockDir blocks;
+		if( p < head.d_pages.size() )
+		{
+			const PostingCodec::PageRef ref = head.d_pages[p++];
+			const bool last = ( p == head.d_pages.size() );
+			int e = d;
+			quint32 nr;
+			Udb::OID doc = 0, item = 0;
+			while( e < to && ( last || ( readKey3( deltas[e].first, nr, doc, item ) > 0 && doc <= ref.d_last ) ) )
+				e++;
+			if( e == d && ref.d_no != 0 )
+			{
+				pages.append( ref );
+				continue;
+			}
+			no = ref.d_no;
+			if( no == 0 )
+				blocks = head.d_blocks;
+			else
+				PostingCodec::readPage( d_post->getCell( writeKey2( tid, no ) ), blocks );
+			blocks = _writeBlocks( d_post, tid, blocks, deltas, d, e, head.d_nextNo, ttf );
+			d = e;
+		}else
+		{
+			blocks = _writeBlocks( d_post, tid, blocks, deltas, d, to, head.d_nextNo, ttf );
+			d = to;
+		}
+		if( blocks.isEmpty() )
+		{
+			if( no != 0 )
+				d_post->setCell( writeKey2( tid, no ), QByteArray() ); // loeschen
+			continue;
+		}
+		// zu grosse Seiten werden geteilt
+		const int n = ( blocks.size() > PostingCodec::MaxPage ) ? int(PostingCodec::PageSize) : blocks.size();
+		for( int i = 0; i < blocks.size(); i += n )
+		{
+			const int j = qMin( i + n, blocks.size() );
+			if( i > 0 || no == 0 )
+				no = head.d_nextNo++;
+			d_post->setCell( writeKey2( tid, no ), PostingCodec::writePage( blocks, i, j ) );
+			pages.append( PostingCodec::makePage( blocks, i, j, no ) );
+		}
+	}
+	head.d_pages = pages;
+	head.d_blocks.clear();
+	head.d_ttf = qMax( ttf, qint64(0) );
+	if( pages.isEmpty() )
+		d_post->setCell( headKey, QByteArray() );
+	else
+		d_post->setCell( headKey, PostingCodec::writeHead( head ) );
+}
+
+quint32 IndexEngine::termId(const QString & term, bool create)
+{
+	const quint32 nr = stemId( ( d_ste ) ? d_ste->stem( term ) : term, create );
+	if( d_useReverseIndex && create )
+		writeReverse( term, nr ); // das muss hier kommen, da ansonsten wegen stemming nicht alle Terms im Index landen
+	if( d_useTrigramIndex && create )
+		writeTrigrams( term, nr );
+	return nr;
+}
+
+void IndexEngine::writeReverse(const QString & term, quint32 id)
+{
+	if( d_revCache.contains( term ) )
+		return;
+	QByteArray key;
+	Udb::Idx::collate( key, 0, _reverse(term) ); // hier wird absichtlich die Originalversion verwendet, nicht stemmed.
+	key.prepend(s_rev);
+	writeDict( key, id );
+	d_revCache.insert( term );
+	d_termCacheSize += term.size() * sizeof(QChar) + s_termOverhead;
+	trimTermCache();
+}
+
+void IndexEngine::writeTrigrams(const QString & raw, quint32 id)
+{
+	if( d_tri == 0 || d_triCache.contains( raw ) )
+		return;
+	const QString term = raw.toLower();
+	const QByteArray utf8 = term.toUtf8();
+	foreach( const QString& tri, _trigrams( s_triBegin + term + s_triEnd ) )
 	{
-		// OR
-		foreach( const QString& s, l )
-			res = unite( res, (joker)?findWithJoker(s,itemAnd,partial):find( s, partial ), !itemAnd );
+		const QByteArray key = writeTriKey( tri, utf8 );
+		if( !d_tri->getCell( key ).isEmpty() )
+			continue;
+		d_tri->setCell( key, writeFreq( id ) );
+		const QByteArray count = tri.toUtf8();
+		d_tri->setCell( count, writeFreq( readFreq( d_tri->getCell( count ) ) + 1 ) );
 	}
-	return res;
+	d_triCache.insert( raw );
+	d_termCacheSize += raw.size() * sizeof(QChar) + s_termOverhead;
+	trimTermCache();
 }
 
-void IndexEngine::commit(bool force)
+quint32 IndexEngine::stemId(const QString & stem, bool create)
 {
-	if( !d_dict->isOpen() )
-		return;
-	d_dict->commit();
-	d_post->commit();
-	if( force || d_index.getTxn() != d_txn )
+	QHash<QString,quint32>::const_iterator i = d_termCache.find( stem );
+	if( i != d_termCache.end() && ( i.value() != 0 || !create ) )
+		return i.value();
+
+	// Terms sind im Array-indizierten Teil von d_index gespeichert und haben als Wert die ID
+	QByteArray key;
+	Udb::Idx::collate( key, 0, stem ); // Udb::IndexMeta::NFKD_CanonicalBase, s.toLower() );
+	quint32 nr = lookupDict( key );
+	if( nr == 0 && create )
 	{
-		d_index.commit();
+		// Term ist noch nicht enthalten; loese neue Nummer und fuege ihn ein
+		nr = nextTermId();
+		writeDict( key, nr );
 	}
+	cacheTerm( stem, nr );
+	return nr;
 }
 
-void IndexEngine::clearIndex()
+quint32 IndexEngine::lookupDict(const QByteArray & key) const
 {
-	if( !d_dict->isOpen() )
-		return;
-	d_dict->clearAllCells();
-	d_post->clearAllCells();
-	d_index.clearValue(AttrMaxTerm);
-	d_index.commit();
+	quint32 tid, df;
+	if( d_terms && d_terms->find( key, tid, df ) )
+		return tid;
+	// Das Delta enthaelt alle Terme, die nicht in der Datei sind, und ist viel kleiner als d_dict
+	QMutexLocker lock( &d_dbLock );
+	return readFreq( ( d_terms ) ? d_delta->getCell( key ) : d_dict->getCell( key ) );
 }
 
-bool IndexEngine::isEmpty() const
+quint32 IndexEngine::findStem(const QString & stem) const
 {
-	return d_index.getValue(AttrMaxTerm).getUInt32() == 0;
+	// Die Abfragen lesen d_termCache nur; Eintraege macht allein der indizierende Thread
+	QHash<QString,quint32>::const_iterator i = d_termCache.find( stem );
+	if( i != d_termCache.end() )
+		return i.value();
+	QByteArray key;
+	Udb::Idx::collate( key, 0, stem );
+	return lookupDict( key );
 }
 
-static QString _kb( quint32 b )
+QString IndexEngine::stemTerm(const QString & term) const
 {
-	return QLocale::c().toString( b / 1024.0, 'f', 1 );
+	if( d_ste == 0 )
+		return term;
+	QMutexLocker lock( &d_poolLock );
+	Stemmer* ste = ( d_stePool.isEmpty() ) ? d_ste->clone() : d_stePool.takeLast();
+	if( ste == 0 )
+		return d_ste->stem( term ); // nicht klonbar; die Abfragen verwenden d_ste nacheinander
+	lock.unlock();
+	const QString res = ste->stem( term );
+	lock.relock();
+	d_stePool.append( ste );
+	return res;
 }
 
-void IndexEngine::test() const
+QStringList IndexEngine::tokenize(const QString & str) const
 {
-	quint32 mkSize = 0, mvSize = 0, mCount = 0;
-	Udb::Git mCur = d_post->findCells( QByteArray() );
-	if( !mCur.isNull() ) do
-	{
-		const QByteArray k = mCur.getKey();
-		mkSize += k.size();
-		mvSize += mCur.getValue().size();
-		mCount++;
-	}while( mCur.nextKey() );
-	qDebug() << "MapTable:" << mCount << _kb(mkSize) << _kb(mvSize);
-	quint32 xkSize = 0, xvSize = 0, xCount = 0;
-	Udb::Git xCur = d_dict->findCells( QByteArray() );
-	if( !xCur.isNull() ) do
+	QStringList res;
+	if( d_tok == 0 )
+		return res;
+	QMutexLocker lock( &d_poolLock );
+	Tokenizer* tok = ( d_tokPool.isEmpty() ) ? d_tok->clone() : d_tokPool.takeLast();
+	const bool shared = tok == 0; // nicht klonbar; die Abfragen verwenden d_tok nacheinander
+	if( shared )
+		tok = d_tok;
+	else
+		lock.unlock();
+	tok->setString( str );
+	for( QString t = tok->nextToken(); !t.isEmpty(); t = tok->nextToken() )
+		res.append( t );
+	if( !shared )
 	{
-		const QByteArray k = xCur.getKey();
-		qDebug() << k;
-		xkSize += k.size();
-		xvSize += xCur.getValue().size();
-		xCount++;
-	}while( xCur.nextKey() );
-	//qDebug() << "OixTable:" << xCount << _kb(xkSize) << _kb(xvSize);
-	//qDebug() << "Total (KB):" << _kb(mkSize+xkSize) << _kb(mvSize+xvSize) << _kb(mkSize+xkSize+mvSize+xvSize);
+		lock.relock();
+		d_tokPool.append( tok );
+	}
+	return res;
 }
 
-IndexEngine *IndexEngine::getIndex(Udb::Transaction * txn)
+void IndexEngine::clearPools()
 {
-	return s_cache.value( txn );
+	QMutexLocker lock( &d_poolLock );
+	qDeleteAll( d_stePool );
+	d_stePool.clear();
+	qDeleteAll( d_tokPool );
+	d_tokPool.clear();
 }
 
-void IndexEngine::onDbUpdate(const Udb::UpdateInfo & info)
+void IndexEngine::writeDict(const QByteArray & key, quint32 id)
 {
-	if( info.d_kind != Udb::UpdateInfo::PreCommit )
-		return;
-	if( d_checkEmpty && isEmpty() )
-		return;
-	Udb::Transaction::Changes::const_iterator i;
-	Udb::Obj o;
-	bool erased = false;
-	bool toProcess = false;
-	bool changes = false;
-	for( i = d_txn->getChanges().begin(); i != d_txn->getChanges().end(); ++i )
+	const QByteArray v = writeFreq( id );
+	d_dict->setCell( key, v );
+	quint32 tid, df;
+	if( d_delta && !( d_terms && d_terms->find( key, tid, df ) ) )
 	{
-		if( i.key().first != o.getOid() )
-		{
-			erased = ( i.key().second == 0 && i.value().isNull() );
-			o = d_txn->getObject( i.key().first );
-			toProcess = d_typesToWatch.isEmpty() || d_typesToWatch.contains( o.getType() );
-			if( o.equals( d_index ) )
-				toProcess = false;
-		}
-		if( toProcess )
-		{
-			if( erased )
-			{
-				QSet<Udb::Atom>::const_iterator j;
-				for( j = d_attrsToWatch.begin(); j != d_attrsToWatch.end(); ++j )
-				{
-					process( o.getValue( (*j), true ), o, true );
-					changes = true;
-				}
-			}else if( d_attrsToWatch.contains( i.key().second ) )
-			{
-				process( o.getValue( i.key().second, true ), o, true );
-				process( o.getValue( i.key().second, false ), o, false );
-				changes = true;
-			}
-		}
+		d_delta->setCell( key, v );
+		d_deltaCount++;
 	}
-	if( changes )
-		commit();
+	d_dictGen++;
 }
 
-void IndexEngine::index(const QString & s, const Udb::Obj & o, bool remove)
+quint32 IndexEngine::nextTermId()
 {
-	const quint32 tid = termId(s,true);
-
-	Udb::Obj doc;
-	if( d_resolveDocuments )
-		doc = getDocument(o);
-	if( doc.isNull() )
-		doc = o;
-
-	const QByteArray key2 = writeKey2( tid, doc.getOid() );
-	qint32 freq = qint32(readFreq(d_post->getCell( key2 )) );
-	if( remove )
-		freq--;
-	else if( freq < std::numeric_limits<qint32>::max() )
-		freq++;
-	else
-		qWarning() << "IndexEngine::index: frequency out of qint32 range";
-	if( freq > 0 )
-		d_post->setCell( key2, writeFreq(freq) ); // term, oid -> freq
-	else
-		d_post->setCell( key2, QByteArray() ); // loeschen
+	if( d_nextTerm == 0 || d_nextTerm > d_lastTerm )
+	{
+		// Statt incCounter pro neuem Term wird ein ganzer Bereich reserviert; nicht vergebene
+		// IDs des Bereichs bleiben einfach ungenutzt.
+		const quint32 max = d_index.getValue(AttrMaxTerm).getUInt32();
+		d_nextTerm = max + 1;
+		d_lastTerm = max + s_termIdRange;
+		d_index.setValue( AttrMaxTerm, Stream::DataCell().setUInt32( d_lastTerm ) );
+	}
+	return d_nextTerm++;
+}
 
-	if( d_resolveDocuments && !doc.equals(o) )
+void IndexEngine::cacheTerm(const QString & stem, quint32 id)
+{
+	QHash<QString,quint32>::iterator i = d_termCache.find( stem );
+	if( i != d_termCache.end() )
 	{
-		const QByteArray key3 = writeKey3( tid, doc.getOid(), o.getOid() );
-		qint32 freq = qint32(readFreq(d_post->getCell( key3 )));
-		if( remove )
-			freq--;
-		else if( freq < std::numeric_limits<qint32>::max() )
-			freq++;
-		else
-			qWarning() << "IndexEngine::index: frequency out of qint32 range";
-		if( freq > 0 )
-			d_post->setCell( key3, writeFreq(freq) ); // term, oid -> freq
-		else
-			d_post->setCell( key3, QByteArray() ); // loeschen
+		i.value() = id; // negativer Eintrag wird positiv
+		return;
 	}
+	d_termCache.insert( stem, id );
+	d_termCacheSize += stem.size() * sizeof(QChar) + s_termOverhead;
+	trimTermCache();
 }
 
-quint32 IndexEngine::termId(const QString & term, bool create)
+void IndexEngine::trimTermCache()
 {
-	// Terms sind im Array-indizierten Teil von d_index gespeichert und haben als Wert die ID
-	QByteArray key;
-	if( d_ste )
-		Udb::Idx::collate( key, 0, d_ste->stem( term ) );
-	else
-		Udb::Idx::collate( key, 0, term ); // Udb::IndexMeta::NFKD_CanonicalBase, s.toLower() );
-	QByteArray nrv = d_dict->getCell( key );
-	quint32 nr = 0;
-	if( nrv.isEmpty() && create )
+	if( d_termCacheSize <= d_termCacheLimit )
+		return;
+	// Auf drei Viertel des Limits reduzieren; die Reihenfolge des Hash ist hinreichend zufaellig.
+	const quint32 target = d_termCacheLimit / 4 * 3;
+	QHash<QString,quint32>::iterator i = d_termCache.begin();
+	while( d_termCacheSize > target && i != d_termCache.end() )
 	{
-		// Term ist noch nicht enthalten; loese neue Nummer und fuege ihn ein
-		nr = d_index.incCounter( AttrMaxTerm );
-		nrv = writeFreq( nr );
-		d_dict->setCell( key, nrv );
-	}else
-		nr = readFreq(nrv);
-	if( d_useReverseIndex && create )
+		d_termCacheSize -= qMin( d_termCacheSize, quint32( i.key().size() * sizeof(QChar) + s_termOverhead ) );
+		i = d_termCache.erase( i );
+	}
+	if( d_termCacheSize > target )
 	{
-		// das muss hier kommen, da ansonsten wegen stemming nicht alle Terms im Index landen
-		Udb::Idx::collate( key, 0, _reverse(term) ); // hier wird absichtlich die Originalversion verwendet, nicht stemmed.
-		key.prepend(s_rev);
-		d_dict->setCell( key, nrv );
+		d_revCache.clear();
+		d_triCache.clear();
+		d_termCacheSize = 0;
 	}
-	return nr;
 }
 
 void IndexEngine::process(const Stream::DataCell & v, const Udb::Obj & o, bool remove)
@@ -495,6 +3239,12 @@ void IndexEngine::process(const Stream::DataCell & v, const Udb::Obj & o, bool r
 		qWarning() << "IndexEngine::process: no Tokenizer set";
 		return;
 	}
+	if( d_change != 0 && o.equals( d_changeObj ) )
+	{
+		// innerhalb von processChange nur sammeln; geschrieben wird dort die Differenz
+		analyze( v.toString(true), ( remove ) ? -1 : 1, *d_change, d_tok, d_ste, d_sto, !remove && keepRaw() );
+		return;
+	}
 	d_tok->setString( v.toString(true) );
 	QString tok = d_tok->nextToken();
 	while( !tok.isEmpty() )
@@ -507,6 +3257,77 @@ void IndexEngine::process(const Stream::DataCell & v, const Udb::Obj & o, bool r
 	}
 }
 
+void IndexEngine::processChange(const Stream::DataCell & oldValue, const Stream::DataCell & newValue, const Udb::Obj & o)
+{
+	// Beide Werte ueber process; was dort in Multisets gesammelt wird und sich aufhebt, verursacht keinen
+	// Schreibzugriff auf d_post. Ein ueberschriebenes process, das IndexEngine::process nicht aufruft,
+	// schreibt wie bisher selber.
+	Terms terms;
+	d_change = &terms;
+	d_changeObj = o;
+	process( oldValue, o, true );
+	process( newValue, o, false );
+	d_change = 0;
+	d_changeObj = Udb::Obj();
+	applyTerms( terms, o );
+}
+
+void IndexEngine::indexPositions(const Udb::Obj & o, Udb::Atom attr, const QString & oldValue, const QString & newValue)
+{
+	if( d_pos == 0 || !d_usePositions || d_tok == 0 )
+		return;
+	Positions oldPos, newPos;
+	analyzePositions( oldValue, oldPos, d_tok, d_ste, d_sto );
+	analyzePositions( newValue, newPos, d_tok, d_ste, d_sto );
+	writePositions( o, attr, oldPos, newPos );
+}
+
+void IndexEngine::writePositions(const Udb::Obj & o, Udb::Atom attr, const Positions & oldPos, const Positions & newPos)
+{
+	if( d_pos == 0 || !d_usePositions )
+		return;
+	Udb::Obj doc;
+	if( d_resolveDocuments )
+		doc = getDocument(o);
+	if( doc.isNull() )
+		doc = o;
+	QMap<quint32,QList<quint32> > positions; // tid -> Positionen
+	Positions::const_iterator j;
+	for( j = newPos.begin(); j != newPos.end(); ++j )
+	{
+		const quint32 tid = stemId( j.key(), false ); // von applyTerms angelegt
+		if( tid != 0 )
+			positions.insert( tid, j.value() );
+	}
+	for( j = oldPos.begin(); j != oldPos.end(); ++j )
+	{
+		const quint32 tid = stemId( j.key(), false );
+		if( tid != 0 && !positions.contains( tid ) )
+		{
+			d_pos->setCell( writePosKey( tid, doc.getOid(), o.getOid(), attr ), QByteArray() ); // loeschen
+			positions.insert( tid, QList<quint32>() ); // nur einmal loeschen
+		}
+	}
+	QMap<quint32,QList<quint32> >::const_iterator i;
+	for( i = positions.begin(); i != positions.end(); ++i )
+	{
+		if( !i.value().isEmpty() )
+			d_pos->setCell( writePosKey( i.key(), doc.getOid(), o.getOid(), attr ), writePosList( i.value() ) );
+	}
+}
+
+void IndexEngine::indexPositions(const Udb::Obj & o, bool removeOldValues)
+{
+	if( d_pos == 0 || !d_usePositions || o.isNull() || o.equals( d_index ) )
+		return;
+	if( !d_typesToWatch.isEmpty() && !d_typesToWatch.contains( o.getType() ) )
+		return;
+	QSet<Udb::Atom>::const_iterator i;
+	for( i = d_attrsToWatch.begin(); i != d_attrsToWatch.end(); ++i )
+		indexPositions( o, (*i), ( removeOldValues ) ? o.getValue( (*i), true ).toString(true) : QString(),
+						o.getValue( (*i), false ).toString(true) );
+}
+
 static Udb::Obj _getDocument(const Udb::Obj & o)
 {
 //	if( o.getType() == Oln::OutlineItem::TID )
@@ -522,9 +3343,161 @@ Udb::Obj IndexEngine::getDocument(const Udb::Obj & o)
 	return s_getDocument(o);
 }
 
+static inline Udb::OID _oid( const IndexEngine::DocHit& h ) { return h.d_doc; }
+static inline Udb::OID _oid( const IndexEngine::ItemHit& h ) { return h.d_item; }
+
+template<class T>
+static int _gallop( const QList<T>& l, int from, Udb::OID oid )
+{
+	// Erster Index ab from mit OID >= oid; zuerst exponentiell vorwaerts, dann binaer im letzten Intervall
+	int lo = from, hi = from, step = 1;
+	while( hi < l.size() && _oid( l[hi] ) < oid )
+	{
+		lo = hi + 1;
+		hi += step;
+		step *= 2;
+	}
+	if( hi > l.size() )
+		hi = l.size();
+	while( lo < hi )
+	{
+		const int mid = lo + ( hi - lo ) / 2;
+		if( _oid( l[mid] ) < oid )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+// Quelle: Baeza-Yates, A Fast Set Intersection Algorithm for Sorted Sequences, bzw. Bentley/Yao 1976.
+// Jedes Element der kurzen Liste wird in der langen Liste galoppierend gesucht; O(m log(n/m)) statt O(m+n).
+static IndexEngine::DocHits _gallopIntersect( const IndexEngine::DocHits& small, const IndexEngine::DocHits& large, bool uniteItems )
+{
+	IndexEngine::DocHits res;
+	int j = 0;
+	for( int i = 0; i < small.size() && j < large.size(); i++ )
+	{
+		j = _gallop( large, j, small[i].d_doc );
+		if( j < large.size() && large[j].d_doc == small[i].d_doc )
+		{
+			IndexEngine::DocHit hit;
+			hit.d_doc = small[i].d_doc;
+			hit.d_rank = small[i].d_rank + large[j].d_rank; // RISK
+			if( uniteItems )
+				hit.d_items = IndexEngine::unite( small[i].d_items, large[j].d_items );
+			else
+				hit.d_items = IndexEngine::intersect( small[i].d_items, large[j].d_items );
+			res.append(hit);
+			j++;
+		}
+	}
+	return res;
+}
+
+static IndexEngine::ItemHits _gallopIntersect( const IndexEngine::ItemHits& small, const IndexEngine::ItemHits& large )
+{
+	IndexEngine::ItemHits res;
+	int j = 0;
+	for( int i = 0; i < small.size() && j < large.size(); i++ )
+	{
+		j = _gallop( large, j, small[i].d_item );
+		if( j < large.size() && large[j].d_item == small[i].d_item )
+		{
+			IndexEngine::ItemHit hit;
+			hit.d_item = small[i].d_item;
+			hit.d_rank = small[i].d_rank + large[j].d_rank; // RISK
+			res.append(hit);
+			j++;
+		}
+	}
+	return res;
+}
+
+static inline IndexEngine::DocHit _join( const IndexEngine::DocHit& l, const IndexEngine::DocHit& r, bool uniteItems )
+{
+	IndexEngine::DocHit hit;
+	hit.d_doc = l.d_doc;
+	hit.d_rank = l.d_rank + r.d_rank; // RISK
+	if( uniteItems )
+		hit.d_items = IndexEngine::unite( l.d_items, r.d_items );
+	else
+		hit.d_items = IndexEngine::intersect( l.d_items, r.d_items );
+	return hit;
+}
+
+static inline IndexEngine::ItemHit _join( const IndexEngine::ItemHit& l, const IndexEngine::ItemHit& r, bool )
+{
+	IndexEngine::ItemHit hit;
+	hit.d_item = l.d_item;
+	hit.d_rank = l.d_rank + r.d_rank; // RISK
+	return hit;
+}
+
+template<class T>
+static inline bool _useKernel( const QList<T>& lhs, const QList<T>& rhs )
+{
+	const int small = qMin( lhs.size(), rhs.size() );
+	return small >= s_kernelMin && qMax( lhs.size(), rhs.size() ) / s_kernelRatio < small;
+}
+
+template<class T>
+static QVector<Udb::OID> _oids( const QList<T>& l )
+{
+	QVector<Udb::OID> res( l.size() );
+	for( int i = 0; i < l.size(); i++ )
+		res[i] = _oid( l[i] );
+	return res;
+}
+
+// Lange Listen werden ueber zusammenhaengende OID-Arrays mit SetKernels verknuepft; die Kernels liefern
+// nur die Positionen, die Hits werden danach in einem Durchgang zusammengesetzt.
+template<class T>
+static QList<T> _kernelIntersect( const QList<T>& lhs, const QList<T>& rhs, bool uniteItems )
+{
+	const QVector<Udb::OID> l = _oids( lhs );
+	const QVector<Udb::OID> r = _oids( rhs );
+	QVector<int> il( qMin( l.size(), r.size() ) );
+	QVector<int> ir( il.size() );
+	const int n = SetKernels::intersect( l.constData(), l.size(), r.constData(), r.size(), il.data(), ir.data() );
+	QList<T> res;
+	res.reserve( n );
+	for( int k = 0; k < n; k++ )
+		res.append( _join( lhs[il[k]], rhs[ir[k]], uniteItems ) );
+	return res;
+}
+
+template<class T>
+static QList<T> _kernelUnite( const QList<T>& lhs, const QList<T>& rhs, bool uniteItems )
+{
+	const QVector<Udb::OID> l = _oids( lhs );
+	const QVector<Udb::OID> r = _oids( rhs );
+	QVector<int> il( l.size() + r.size() );
+	QVector<int> ir( il.size() );
+	const int n = SetKernels::unite( l.constData(), l.size(), r.constData(), r.size(), il.data(), ir.data() );
+	QList<T> res;
+	res.reserve( n );
+	for( int k = 0; k < n; k++ )
+	{
+		if( ir[k] < 0 )
+			res.append( lhs[il[k]] );
+		else if( il[k] < 0 )
+			res.append( rhs[ir[k]] );
+		else
+			res.append( _join( lhs[il[k]], rhs[ir[k]], uniteItems ) );
+	}
+	return res;
+}
+
 // Quelle: http://stackoverflow.com/questions/2400157/the-intersection-of-two-sorted-arrays
 IndexEngine::DocHits IndexEngine::intersect(const IndexEngine::DocHits &lhs, const IndexEngine::DocHits &rhs, bool uniteItems)
 {
+	if( lhs.size() / HitList::GallopRatio > rhs.size() )
+		return _gallopIntersect( rhs, lhs, uniteItems );
+	if( rhs.size() / HitList::GallopRatio > lhs.size() )
+		return _gallopIntersect( lhs, rhs, uniteItems );
+	if( _useKernel( lhs, rhs ) )
+		return _kernelIntersect( lhs, rhs, uniteItems );
 	DocHits res;
 	int i = 0, j = 0;
 	while( i < lhs.size() && j < rhs.size() )
@@ -551,6 +3524,8 @@ IndexEngine::DocHits IndexEngine::intersect(const IndexEngine::DocHits &lhs, con
 
 IndexEngine::DocHits IndexEngine::unite(const IndexEngine::DocHits &lhs, const IndexEngine::DocHits &rhs, bool uniteItems)
 {
+	if( _useKernel( lhs, rhs ) )
+		return _kernelUnite( lhs, rhs, uniteItems );
 	DocHits res;
 	int i = 0, j = 0;
 	while( i < lhs.size() && j < rhs.size() )
@@ -582,6 +3557,12 @@ IndexEngine::DocHits IndexEngine::unite(const IndexEngine::DocHits &lhs, const I
 
 IndexEngine::ItemHits IndexEngine::intersect(const IndexEngine::ItemHits &lhs, const IndexEngine::ItemHits &rhs)
 {
+	if( lhs.size() / HitList::GallopRatio > rhs.size() )
+		return _gallopIntersect( rhs, lhs );
+	if( rhs.size() / HitList::GallopRatio > lhs.size() )
+		return _gallopIntersect( lhs, rhs );
+	if( _useKernel( lhs, rhs ) )
+		return _kernelIntersect( lhs, rhs, false );
 	ItemHits res;
 	int i = 0, j = 0;
 	while( i < lhs.size() && j < rhs.size() )
@@ -605,6 +3586,8 @@ IndexEngine::ItemHits IndexEngine::intersect(const IndexEngine::ItemHits &lhs, c
 // Quelle: http://www.geeksforgeeks.org/union-and-intersection-of-two-sorted-arrays-2/
 IndexEngine::ItemHits IndexEngine::unite(const IndexEngine::ItemHits &lhs, const IndexEngine::ItemHits &rhs)
 {
+	if( _useKernel( lhs, rhs ) )
+		return _kernelUnite( lhs, rhs, false );
 	ItemHits res;
 	int i = 0, j = 0;
 	while( i < lhs.size() && j < rhs.size() )
@@ -630,5 +3613,131 @@ IndexEngine::ItemHits IndexEngine::unite(const IndexEngine::ItemHits &lhs, const
 	return res;
 }
 
+// Position des ersten Elements >= oid ab from; galoppierend, wenn rhs viel laenger ist als lhs
+template<class T>
+static inline int _seek( const QList<T>& l, int from, Udb::OID oid, bool gallop )
+{
+	if( gallop )
+		return _gallop( l, from, oid );
+	while( from < l.size() && _oid( l[from] ) < oid )
+		from++;
+	return from;
+}
+
+IndexEngine::ItemHits IndexEngine::subtract(const IndexEngine::ItemHits &lhs, const IndexEngine::ItemHits &rhs)
+{
+	if( rhs.isEmpty() )
+		return lhs;
+	const bool gallop = rhs.size() / HitList::GallopRatio > lhs.size();
+	ItemHits res;
+	int j = 0;
+	for( int i = 0; i < lhs.size(); i++ )
+	{
+		j = _seek( rhs, j, lhs[i].d_item, gallop );
+		if( j >= rhs.size() || rhs[j].d_item != lhs[i].d_item )
+			res.append( lhs[i] );
+	}
+	return res;
+}
+
+IndexEngine::DocHits IndexEngine::subtract(const IndexEngine::DocHits &lhs, const IndexEngine::DocHits &rhs, bool subtractItems)
+{
+	if( rhs.isEmpty() )
+		return lhs;
+	const bool gallop = rhs.size() / HitList::GallopRatio > lhs.size();
+	DocHits res;
+	int j = 0;
+	for( int i = 0; i < lhs.size(); i++ )
+	{
+		j = _seek( rhs, j, lhs[i].d_doc, gallop );
+		if( j >= rhs.size() || rhs[j].d_doc != lhs[i].d_doc )
+			res.append( lhs[i] );
+		else if( subtractItems && !rhs[j].d_items.isEmpty() )
+		{
+			if( lhs[i].d_items.isEmpty() )
+				res.append( lhs[i] ); // lhs trifft das Doc selber, rhs nur Items
+			else
+			{
+				DocHit hit = lhs[i];
+				hit.d_items = subtract( lhs[i].d_items, rhs[j].d_items );
+				if( !hit.d_items.isEmpty() )
+					res.append( hit );
+			}
+		}
+	}
+	return res;
+}
 
+static IndexEngine::DocHits _linearIntersect( const IndexEngine::DocHits& lhs, const IndexEngine::DocHits& rhs )
+{
+	// Referenz fuer benchmarkIntersect; entspricht dem linearen Teil von intersect ohne Items
+	IndexEngine::DocHits res;
+	int i = 0, j = 0;
+	while( i < lhs.size() && j < rhs.size() )
+	{
+		if( lhs[i].d_doc == rhs[j].d_doc )
+		{
+			IndexEngine::DocHit hit;
+			hit.d_doc = lhs[i].d_doc;
+			hit.d_rank = lhs[i].d_rank + rhs[j].d_rank;
+			res.append(hit);
+			i++;
+			j++;
+		}else if( lhs[i].d_doc > rhs[j].d_doc )
+			j++;
+		else
+			i++;
+	}
+	return res;
+}
 
+void IndexEngine::benchmarkIntersect()
+{
+	// Eine grosse Liste mit 200k Docs gegen kleine Listen, deren Elemente zur Haelfte in der grossen
+	// vorkommen. Der Quotient, ab dem gallop schneller ist, bestimmt HitList::GallopRatio. Der Kernel laeuft mit
+	// der zur Laufzeit gewaehlten SetKernels::isa().
+	const int large = 200000;
+	DocHits big;
+	Udb::OID oid = 0;
+	quint32 seed = 1;
+	for( int i = 0; i < large; i++ )
+	{
+		seed = seed * 1103515245 + 12345;
+		oid += 2 + ( seed >> 16 ) % 8; // Luecken, damit d_doc++ unten eindeutig bleibt
+		DocHit h;
+		h.d_doc = oid;
+		h.d_rank = 1;
+		big.append( h );
+	}
+	const int ratios[] = { 1, 2, 4, 8, 16, 32, 64, 128, 512, 2048, 20000, 0 };
+	for( int r = 0; ratios[r] != 0; r++ )
+	{
+		DocHits small;
+		for( int i = 0; i < large; i += ratios[r] )
+		{
+			DocHit h = big[i];
+			if( ( i / ratios[r] ) % 2 )
+				h.d_doc++; // kommt in big nicht vor
+			small.append( h );
+		}
+		const int rounds = qMax( 1, 2000 / ( large / small.size() + 1 ) ) ;
+		QElapsedTimer t;
+		t.start();
+		int n1 = 0, n2 = 0;
+		for( int k = 0; k < rounds; k++ )
+			n1 += _linearIntersect( small, big ).size();
+		const qint64 linear = t.nsecsElapsed() / rounds;
+		t.start();
+		for( int k = 0; k < rounds; k++ )
+			n2 += _gallopIntersect( small, big, false ).size();
+		const qint64 gallop = t.nsecsElapsed() / rounds;
+		t.start();
+		int n3 = 0;
+		for( int k = 0; k < rounds; k++ )
+			n3 += _kernelIntersect( small, big, false ).size();
+		const qint64 kernel = t.nsecsElapsed() / rounds;
+		qDebug() << "IndexEngine::benchmarkIntersect ratio" << ratios[r] << "sizes" << small.size() << big.size()
+				 << "linear us" << linear / 1000 << "gallop us" << gallop / 1000 << "kernel us" << kernel / 1000
+				 << ( ( n1 == n2 && n1 == n3 ) ? "" : "MISMATCH" );
+	}
+}
@@ -24,16 +24,38 @@
 #include <Udb/Obj.h>
 #include <Udb/UpdateInfo.h>
 #include <QSet>
+#include <QHash>
+#include <QStringList>
+#include <QMap>
+#include <QVector>
+#include <QMutex>
+#include <QReadWriteLock>
+
+namespace Udb
+{
+	class Git;
+}
 
 namespace Fts
 {
+	class Cursor;
+	class Automaton;
 	class Tokenizer;
 	class Stemmer;
 	class Stopper;
+	class HitList;
+	class TermFile;
+	class PostingCache;
+	class QueryNode;
 
 	class IndexEngine : public QObject
 	{
 		Q_OBJECT
+		friend class TermCursor;
+		friend class PostingCursor;
+		friend class Scorer;
+		friend class LengthReader;
+		friend class PositionCursor;
 	public:
 		struct ItemHit
 		{
@@ -48,10 +70,42 @@ namespace Fts
 			ItemHits d_items; // unique OID, ordered by OID
 		};
 		typedef QList<DocHit> DocHits; // unique OID, ordered by OID
+		struct Term
+		{
+			qint32 d_freq; // Summe der Vorkommen; negativ fuer zu entfernende Werte
+			QStringList d_raw; // Originalformen fuer den reverse Index
+			Term():d_freq(0) {}
+		};
+		typedef QHash<QString,Term> Terms; // stem -> Term
+		typedef QHash<QString,QList<quint32> > Positions; // stem -> Positionen der Tokens in einem Wert
+		struct TermStats
+		{
+			quint32 d_df;  // Anzahl Docs mit dem Term
+			quint64 d_ttf; // Summe der Haeufigkeiten ueber alle Docs
+			TermStats():d_df(0),d_ttf(0) {}
+		};
+		enum PostingFormat { RowFormat, BlockFormat };
+		enum Scoring { FrequencyScoring, Bm25Scoring };
+		typedef QPair<QByteArray,qint32> Delta; // key2/key3 -> freq delta
+		struct ExpandedTerm
+		{
+			QByteArray d_key; // Schluessel im Dictionary
+			quint32 d_tid;
+			quint32 d_df;
+		};
+		typedef QVector<ExpandedTerm> Expansion; // nach d_key sortiert
+		static void analyze( const QString&, qint32 sign, Terms&, Tokenizer*, Stemmer*, Stopper*, bool keepRaw );
+		static void analyzePositions( const QString&, Positions&, Tokenizer*, Stemmer*, Stopper* );
 		static ItemHits unite( const ItemHits& lhs, const ItemHits& rhs );
 		static ItemHits intersect( const ItemHits& lhs, const ItemHits& rhs );
 		static DocHits intersect( const DocHits& lhs, const DocHits& rhs, bool uniteItems );
 		static DocHits unite( const DocHits& lhs, const DocHits& rhs, bool uniteItems );
+		// Differenz: Items bzw. Docs von lhs, die nicht in rhs sind; rank bleibt der von lhs. Mit subtractItems
+		// verlieren gemeinsame Docs nur die Items von rhs und fallen weg, wenn keine mehr bleiben; trifft rhs das
+		// Doc selber (ohne Items), faellt es ganz weg, trifft lhs das Doc selber, bleibt es.
+		static ItemHits subtract( const ItemHits& lhs, const ItemHits& rhs );
+		static DocHits subtract( const DocHits& lhs, const DocHits& rhs, bool subtractItems );
+		static void benchmarkIntersect(); // vergleicht lineares und galoppierendes intersect, Ausgabe mit qDebug
 
 		static Udb::Obj (*s_getDocument)( const Udb::Obj& );
 		explicit IndexEngine( const Udb::Obj& index, Udb::Transaction* = 0, QObject *parent = 0);
@@ -62,9 +116,135 @@ namespace Fts
 		void setStemmer( Stemmer* t );
 		void setStopper( Stopper* s );
 		void indexObject( const Udb::Obj&, bool removeOldValues = true );
+		// Wie indexObject fuer alle Objekte, aber Tokenizer, Stemmer und Stopper laufen parallel in threadCount
+		// Threads (0..idealThreadCount) auf Klonen; geschrieben wird nur im aufrufenden Thread.
+		// Ein ueberschriebenes process wird dabei nicht aufgerufen.
+		void reindexAll( const QList<Udb::Obj>&, int threadCount = 0, bool removeOldValues = true );
+		// Bulk-Modus: Postings werden im Speicher gesammelt und erst bei endBulk, commit oder bei
+		// Ueberschreiten von bulkLimit sortiert in d_post geschrieben. find sieht bis dahin nur den alten Stand.
+		// indexObject und die Aenderungen eines Commits laufen immer in einem Bulk, damit jede Zelle und die
+		// Laenge jedes Docs nur einmal geschrieben werden.
+		void beginBulk();
+		void endBulk();
+		void flushBulk();
+		bool isBulk() const { return d_bulkLevel > 0; }
+		void setBulkLimit( quint32 bytes ) { d_bulkLimit = bytes; } // 0..unbeschraenkt
+		quint32 getBulkLimit() const { return d_bulkLimit; }
+		void setTermCacheLimit( quint32 bytes );
+		quint32 getTermCacheLimit() const { return d_termCacheLimit; }
+		void clearTermCache();
+		// Begrenzt die Expansion eines Praefix (partial, Joker) auf die limit Terme mit der groessten
+		// Dokumentfrequenz; 0..unbeschraenkt. Die letzten Expansionen bleiben bis zur naechsten Aenderung
+		// des Dictionary zwischengespeichert; ein laengerer Praefix wird aus einem kuerzeren abgeleitet.
+		// Die df fuer die Auswahl stammt vom Zeitpunkt, zu dem der Term zuerst expandiert wurde, bzw. mit
+		// angehaengter TermFile aus der Datei.
+		void setExpansionLimit( quint32 limit );
+		quint32 getExpansionLimit() const { return d_expansionLimit; }
+		void clearExpansionCache();
+		// Resultate von find und findHits mit Begriffsliste bleiben bis zu bytes zwischengespeichert, die zuletzt
+		// verwendeten zuerst; 0..aus. Schluessel sind die kleingeschriebenen und gestemmten Begriffe samt Flags.
+		// Jede Aenderung der Postings, commit, clearIndex und setScoring machen alle Eintraege ungueltig.
+		void setResultCacheLimit( quint32 bytes );
+		quint32 getResultCacheLimit() const { return d_resultLimit; }
+		void clearResultCache();
+		quint32 getResultCacheHits() const { return d_resultHits; } // seit Erzeugung der Engine
+		quint32 getResultCacheMisses() const { return d_resultMisses; }
+		// Dekodierte Postings haeufiger Terme, unabhaengig von der Abfrage (siehe PostingCache); 0..aus.
+		// Ein Eintrag wird ungueltig, sobald sich die Postings seines Terms aendern.
+		void setPostingCacheLimit( quint32 bytes );
+		quint32 getPostingCacheLimit() const;
+		void clearPostingCache();
+		const PostingCache* getPostingCache() const { return d_postCache; } // fuer die Statistik
+		class Bulk
+		{
+		public:
+			Bulk( IndexEngine* e ):d_eng(e) { d_eng->beginBulk(); }
+			~Bulk() { d_eng->endBulk(); }
+		private:
+			IndexEngine* d_eng;
+		};
+		// Mehrere Threads koennen gleichzeitig abfragen (die const-Funktionen), waehrend ein Thread indiziert;
+		// Aenderungen des Index warten, bis keine Abfrage mehr laeuft, und umgekehrt. Die Abfragen stemmen und
+		// zerlegen mit Klonen von Stemmer und Tokenizer aus einem Pool (ohne clone teilen sie sich das eine
+		// Exemplar); Stopper::isStopword darf nichts veraendern. Nur die Zugriffe der Abfragen auf Udb laufen
+		// nacheinander, dekodieren, bewerten und verknuepfen parallel. Darum gehoert der Index in eine eigene Db,
+		// die sonst niemand verwendet. Setter wie setTokenizer, addQueryField oder useTrigramIndex kommen vor
+		// dem Start der Abfrage-Threads.
+		// Ein Cursor liest erst beim Weiterschalten; wer ihn neben einem indizierenden Thread verwendet, haelt
+		// solange einen Reader, ebenso fuer mehrere Abfragen auf demselben Stand des Index. Der Thread mit dem
+		// Reader darf selber weder committen noch indizieren, bis der Reader weg ist: onDbUpdate, indexObject usw.
+		// warten auf das Schreibrecht und damit auf ihn (Deadlock; im Debug-Build ein Q_ASSERT).
+		class Reader
+		{
+		public:
+			Reader( const IndexEngine* e ):d_eng(e) { d_eng->d_lock.lockForRead(); d_eng->addReader( true ); }
+			~Reader() { d_eng->addReader( false ); d_eng->d_lock.unlock(); }
+		private:
+			const IndexEngine* d_eng;
+		};
 		DocHits findWithJoker( const QString&, bool itemAnd, bool partial ) const; // '*' ist Joker
 		DocHits find( const QString&, bool partial, bool reverse = false ) const;
 		DocHits find( const QStringList&, bool docAnd, bool itemAnd, bool joker, bool partial ) const;
+		// Wie find bzw. findWithJoker, aber mit dem allokationsarmen HitList als Resultat (siehe HitList.h)
+		HitList findHitsWithJoker( const QString&, bool itemAnd, bool partial ) const;
+		HitList findHits( const QString&, bool partial, bool reverse = false ) const;
+		HitList findHits( const QStringList&, bool docAnd, bool itemAnd, bool joker, bool partial ) const;
+		// Muster mit beliebig vielen '*' und '?' ueber die Originalformen der Terme, z.B. "*konfig*";
+		// braucht den Trigramm-Index und drei Zeichen am Stueck. findWithJoker verwendet es fuer Muster, die es
+		// sonst nicht kann; ohne drei Zeichen am Stueck nimmt es stattdessen findMatching.
+		DocHits findWithPattern( const QString& ) const;
+		HitList findHitsWithPattern( const QString& ) const;
+		// Terme des Dictionary (Staemme, wenn ein Stemmer gesetzt ist), auf die das Muster ganz passt; syntax ist
+		// PatternAutomaton::Syntax. Liest nur die Bereiche des Dictionary, deren Anfang noch passen kann.
+		// Der Automat laeuft ueber die Zeichen; Terme, deren Schluessel nicht UTF-8 ist oder sich durch
+		// Idx::collate aendert, werden darum nicht gefunden (ebenso bei Jokern in findQuery).
+		DocHits findMatching( const QString&, int syntax = 0 ) const;
+		HitList findHitsMatching( const QString&, int syntax = 0 ) const;
+		// Unscharfe Suche: Terme mit hoechstens maxEdits (0..2) Einfuegungen, Loeschungen, Ersetzungen und optional
+		// Vertauschungen benachbarter Zeichen. Der Suchbegriff wird wie bei find gestemmt; die ersten prefixLength
+		// Zeichen muessen stimmen, mit 0 wird das ganze Dictionary gelesen.
+		QStringList findFuzzyTerms( const QString&, int maxEdits = 1, bool transpositions = true, int prefixLength = 1 ) const;
+		DocHits findFuzzy( const QString&, int maxEdits = 1, bool transpositions = true, int prefixLength = 1 ) const;
+		HitList findHitsFuzzy( const QString&, int maxEdits = 1, bool transpositions = true, int prefixLength = 1 ) const;
+		// Die k besten Docs nach d_rank absteigend (bei gleichem Rang nach OID), ohne Items. OR laeuft ueber
+		// Block-Max-WAND (siehe TermCursor::topK) und dekodiert im BlockFormat nur Bloecke, die noch unter die
+		// ersten k kommen koennen; das RowFormat hat weder Verzeichnis noch Block-Maxima, dort werden alle
+		// Postings gelesen. AND laeuft ueber den Cursor wie cursor() und behaelt nur die besten k.
+		DocHits findTop( const QStringList&, int k, bool docAnd, bool joker, bool partial ) const;
+		// Wie find, aber als Cursor in OID-Reihenfolge, der erst beim Weiterschalten auswertet (siehe Cursors.h).
+		// Nur Docs, ohne Items; rank wie bei find. Der Aufrufer loescht den Cursor; er ist nur gueltig,
+		// solange der Index nicht geaendert wird.
+		Cursor* cursor( const QString&, bool partial ) const;
+		Cursor* cursor( const QStringList&, bool docAnd, bool joker, bool partial ) const;
+		// Phrase: die Tokens folgen im selben Feld (Objekt und Attribut) wie im Suchbegriff aufeinander; ein
+		// Stoppwort im Suchbegriff steht fuer ein beliebiges Token. NEAR: alle Terme im selben Feld mit hoechstens
+		// distance Tokens zwischen dem ersten und dem letzten, mit ordered in der gegebenen Reihenfolge.
+		// rank ist die Anzahl Treffer. Die Positionen werden nur fuer die Docs der Schnittmenge gelesen; braucht
+		// usePositions beim Indizieren.
+		DocHits findPhrase( const QString& ) const;
+		DocHits findNear( const QStringList&, int distance, bool ordered = false ) const;
+		Cursor* phraseCursor( const QString& ) const;
+		Cursor* nearCursor( const QStringList&, int distance, bool ordered = false ) const;
+		// Abfragesprache mit AND, OR, NOT, Klammern, Phrasen, Feldern und Jokern, siehe Query.h. Die Teile einer
+		// Konjunktion werden nach der geschaetzten Anzahl Docs geordnet und das Ganze als ein Cursor ausgewertet,
+		// ohne Zwischenresultate. Nur Docs; rank ist die Summe ueber die positiven Teile, Felder und Phrasen zaehlen
+		// Treffer wie findPhrase. Joker ausser am Ende laufen mit dem Automaten ueber das Dictionary wie
+		// findMatching. Stoppwoerter werden ignoriert. Bei einem Syntaxfehler ist das Resultat leer (qWarning).
+		DocHits findQuery( const QString& ) const;
+		Cursor* queryCursor( const QString& ) const;
+		// Name fuer feld:... in der Abfragesprache; Felder brauchen usePositions beim Indizieren
+		void addQueryField( const QString& name, Udb::Atom );
+		// Statistik eines Terms; der Suchbegriff wird wie bei find gestemmt. Wird von index() nachgefuehrt;
+		// Indizes aus aelteren Versionen haben erst nach clearIndex und Neuindizierung korrekte Werte.
+		TermStats getTermStats( const QString& ) const;
+		TermStats getTermStats( quint32 tid ) const;
+		// Relevanz in d_rank: Summe der Haeufigkeiten oder BM25 mit Faktor 1000 als Ganzzahl, berechnet beim
+		// Lesen der Postings. Die Laengen der Docs (indizierte Tokens) werden in jedem Fall nachgefuehrt.
+		void setScoring( Scoring, float k1 = 1.2f, float b = 0.75f );
+		Scoring getScoring() const { return d_scoring; }
+		quint32 getDocLength( Udb::OID doc ) const;
+		quint32 getDocCount() const; // Docs mit mindestens einem indizierten Token
+		quint64 getTotalLength() const;
 		Udb::Transaction* getTxn() const { return d_txn; }
 		void commit(bool force = false);
 		void clearIndex();
@@ -72,38 +252,226 @@ namespace Fts
 		void test() const;
 		bool useReverseIndex() const { return d_useReverseIndex; }
 		void useReverseIndex(bool on) { d_useReverseIndex = on; }
+		// Trigramm -> Terme im eigenen Global; erfasst nur Terme, die danach indiziert werden
+		bool useTrigramIndex() const { return d_useTrigramIndex; }
+		void useTrigramIndex(bool on);
+		// Positionen der Tokens pro Feld im eigenen Global; erfasst nur Werte, die danach indiziert werden
+		bool usePositions() const { return d_usePositions; }
+		void usePositions(bool on);
+		// Kopie des Dictionary als Datei, die per mmap statt ueber Udb gelesen wird (siehe TermFile). Danach
+		// erfasste Terme stehen bis zum naechsten writeTermFile zusaetzlich in einem kleinen Delta-Global.
+		// attachTermFile lehnt Dateien ab, die nicht vom letzten writeTermFile dieses Index stammen.
+		bool writeTermFile( const QString& path );
+		bool attachTermFile( const QString& path );
+		void detachTermFile();
+		bool hasTermFile() const { return d_terms != 0; }
+		// Hat das Delta nach einem commit so viele Terme, wird die angehaengte Datei danach aus der Event-Loop
+		// heraus neu geschrieben; 0..nie
+		void setTermFileRebuild( quint32 terms ) { d_termRebuild = terms; }
+		quint32 getTermFileRebuild() const { return d_termRebuild; }
 		bool resolveDocuments() const { return d_resolveDocuments; }
 		void resolveDocuments(bool on) { d_resolveDocuments = on; }
 		bool checkEmpty() const { return d_checkEmpty; }
 		void checkEmpty(bool on) { d_checkEmpty = on; }
+		// RowFormat: eine Zelle pro (Term, Doc) bzw. (Term, Doc, Item); BlockFormat siehe PostingCodec.
+		// Das Format kann nur geaendert werden, solange der Index leer ist.
+		bool setPostingFormat( PostingFormat );
+		PostingFormat getPostingFormat() const { return d_format; }
+		// Asynchroner Modus: beim Commit werden nur die geaenderten (Objekt, Attribut) mit dem zuletzt
+		// indizierten Wert in einer persistenten Queue vermerkt und danach portionenweise aus der
+		// Event-Loop heraus indiziert. Jeder Commit erhaelt ein fortlaufendes Ticket. Ausschalten, indexObject
+		// und reindexAll arbeiten zuerst die ganze Queue ab, ebenso ein Commit im synchronen Modus, solange noch etwas darin steht.
+		void setAsync( bool on );
+		bool isAsync() const { return d_async; }
+		quint32 getLastTicket() const { return d_lastTicket; } // Ticket des letzten Commits
+		quint32 getIndexedTicket() const; // alle Commits bis und mit diesem Ticket sind im Index
+		int getIndexLag() const { return d_queueCount; } // Anzahl noch nicht indizierter Eintraege
+		bool waitForIndexed( quint32 ticket, int msecs = -1 ); // indiziert synchron bis ticket; false..Timeout
 		static IndexEngine* getIndex( Udb::Transaction* ); // funktioniert sowohl fr Db als auch Index Txn
 	private slots:
 		void onDbUpdate( const Udb::UpdateInfo& info );
+		void onDrain();
+		void onRebuild();
 	protected:
 		enum Attrs
 		{
 			AttrMaxTerm = 20, // UInt32
 			AttrDict = 21,    // Id32
-			AttrPosts = 22    // Id32
+			AttrPosts = 22,   // Id32
+			AttrQueue = 23,   // Id32
+			AttrTicket = 24,  // UInt32
+			AttrFormat = 25,  // UInt32, PostingFormat
+			AttrTrigrams = 26, // Id32
+			AttrTermFile = 27, // UInt32, Snapshot des letzten writeTermFile
+			AttrDelta = 28,    // Id32
+			AttrPositions = 29 // Id32
 		};
 
 		void index( const QString&, const Udb::Obj&, bool remove = false );
+		void applyTerms( const Terms&, const Udb::Obj& );
+		void writeReverse( const QString& term, quint32 id );
+		void writeTrigrams( const QString& term, quint32 id );
+		QList<quint32> patternIds( const QString& ) const; // Stamm-IDs der Terme, auf die das Muster passt
+		typedef QPair<QString,quint32> TermMatch; // Term -> ID
+		// Terme unter prefix, deren Rest der Automat akzeptiert; nur Schluessel, die Idx::collate( fromUtf8 ) wieder ergibt
+		QList<quint32> automatonIds( const Automaton&, const QString& prefix = QString() ) const;
+		QList<TermMatch> automatonTerms( const Automaton&, const QString& prefix = QString() ) const;
+		void matchRange( const Automaton&, int state, const QString& prefix, int& budget, QList<TermMatch>& ) const;
+		QList<TermMatch> fuzzyTerms( const QString&, int maxEdits, bool transpositions, int prefixLength ) const;
+		bool keepRaw() const { return d_useReverseIndex || d_useTrigramIndex; }
+		struct PositionQuery
+		{
+			QList<quint32> d_tids;
+			QList<int> d_offsets; // nur Phrase: Position im Suchbegriff
+			int d_distance;
+			bool d_ordered;
+			bool d_phrase;
+			Udb::Atom d_attr; // 0..alle Felder
+			PositionQuery():d_distance(0),d_ordered(false),d_phrase(false),d_attr(0) {}
+		};
+		// Schreibt die Positionen des Felds neu; alte Positionen nur fuer die Terme von oldValue loeschen
+		void indexPositions( const Udb::Obj&, Udb::Atom, const QString& oldValue, const QString& newValue );
+		void indexPositions( const Udb::Obj&, bool removeOldValues );
+		void writePositions( const Udb::Obj&, Udb::Atom, const Positions& oldPos, const Positions& newPos );
+		bool phraseQuery( const QString&, PositionQuery& ) const; // false, wenn ein Term nicht im Index ist
+		bool nearQuery( const QStringList&, int distance, bool ordered, PositionQuery& ) const;
+		Cursor* positionCursor( const PositionQuery& ) const;
+		DocHits findPositions( const PositionQuery& ) const;
+		quint32 matchPositions( const PositionQuery&, Udb::OID doc, ItemHits* ) const; // Anzahl Treffer im Doc
+		// Auswertungsplan einer Abfrage: Term-IDs bzw. Positionen sind aufgeloest, Teile ohne Treffer entfernt
+		struct QueryPlan
+		{
+			int d_op; // QueryNode::Op
+			QList<quint32> d_tids; // Term
+			PositionQuery d_query; // Phrase und Near; Term nur mit Feld in d_attr
+			quint64 d_cost; // geschaetzte Anzahl Docs
+			QList<QueryPlan> d_subs; // And nach d_cost aufsteigend, Or
+			QList<QueryPlan> d_excluded; // And: NOT-Teile
+			QueryPlan():d_op(0),d_cost(0) {}
+		};
+		enum PlanResult { PlanEmpty, PlanIgnored, PlanOk }; // PlanIgnored..nur Stoppwoerter
+		PlanResult planQuery( const QueryNode*, QueryPlan& ) const;
+		Cursor* compileQuery( const QueryPlan& ) const;
+		QList<quint32> queryTermIds( const QString& ) const;
+		Cursor* termCursor( quint32 tid ) const; // TermCursor bzw. PostingCursor je nach Format
+		void enqueue( const Udb::Obj&, Udb::Atom, quint32 ticket );
+		int drainQueue( int maxEntries );
+		void drainAll(); // bis die Queue leer ist
 		quint32 termId( const QString&, bool create = true );
+		quint32 stemId( const QString& stem, bool create );
+		quint32 findStem( const QString& stem ) const; // wie stemId ohne create, aber ohne den Cache zu fuellen
+		quint32 lookupDict( const QByteArray& key ) const; // Term-ID oder 0
+		QString stemTerm( const QString& ) const; // fuer Abfragen, mit einem Stemmer aus dem Pool
+		QStringList tokenize( const QString& ) const; // fuer Abfragen, mit einem Tokenizer aus dem Pool
+		void clearPools();
+		void writeDict( const QByteArray& key, quint32 id );
+		quint32 nextTermId();
+		void cacheTerm( const QString& stem, quint32 id );
+		void trimTermCache();
+		void addPosting( const QByteArray& key, qint32 delta );
+		void writePosting( const QByteArray& key, qint32 delta );
+		void writeBlockDeltas( quint32 term, const QVector<Delta>&, int from, int to ); // sortiert
+		HitList readHits( quint32 term, bool score = true ) const; // nach OID sortiert, rank ist die Haeufigkeit bzw. BM25
+		HitList decodeHits( quint32 term ) const; // wie readHits, aber immer Haeufigkeiten und ohne Cache
+		TermStats readTermStats( quint32 term ) const; // wie getTermStats, aber ohne d_lock
+		bool hasTerms() const; // wie !isEmpty, aber ohne d_lock
+		void addReader( bool ) const; // nur Debug, siehe Reader
+		bool holdsReader() const; // der aktuelle Thread hat einen Reader; nur im Debug-Build nachgefuehrt
+		QByteArray readHeadCell( quint32 term ) const; // Statistik bzw. PostingCodec::Head
+		QByteArray readBlockCell( quint32 term, quint32 no ) const; // nur BlockFormat, Block oder Seite des Verzeichnisses
+		Udb::Git findPostings( quint32 term ) const; // nur RowFormat; beginnt mit der Statistik des Terms
+		Udb::Git findLengths() const; // wie findPostings fuer die Laengen der Docs
+		quint32 readDocLength( Udb::OID ) const; // wie getDocLength, aber der Aufrufer haelt d_dbLock
+		static int readPostingKey( const QByteArray&, quint32& term, Udb::OID& doc, Udb::OID& item );
+		static quint32 readPostingFreq( const QByteArray& );
+		// wie termIds, aber mit Joker wie findHitsWithJoker; false, wenn der Begriff nicht auf Term-IDs
+		// abgebildet werden kann und stattdessen in resolved ausgewertet ist
+		bool expandTerm( const QString&, bool joker, bool partial, QList<quint32>& nrs, HitList& resolved ) const;
+		QList<quint32> termIds( const QString&, bool partial, bool reverse ) const; // wie find, aber nur Term-IDs
+		QList<quint32> expandPrefix( const QByteArray& key ) const; // Term-IDs unter key, siehe setExpansionLimit
+		quint64 estimateDocs( const QString&, bool joker, bool partial ) const; // Obergrenze aus TermStats
+		HitList evalHits( const QStringList&, bool docAnd, bool itemAnd, bool joker, bool partial ) const; // ohne Cache
+		QString resultKey( const QStringList&, bool docAnd, bool itemAnd, bool joker, bool partial ) const;
+		void trimResultCache( quint32 limit ) const;
+		void flushStats();
 		// to override
 		virtual void process( const Stream::DataCell&, const Udb::Obj&, bool remove );
+		// Wert eines Attributs hat sich geaendert; ruft process mit remove fuer den alten und ohne fuer den
+		// neuen Wert. IndexEngine::process sammelt dabei nur, und es wird die Differenz der Term-Haeufigkeiten
+		// geschrieben; ein ueberschriebenes process kann es also mit gefilterten Werten aufrufen.
+		virtual void processChange( const Stream::DataCell& oldValue, const Stream::DataCell& newValue, const Udb::Obj& );
 		virtual Udb::Obj getDocument( const Udb::Obj& );
 	private:
 		Udb::Obj d_index; // in Index-Db
 		Udb::Global* d_dict; // in Index-Db
 		Udb::Global* d_post; // in Index-Db
+		Udb::Global* d_queue; // in Index-Db, nur im asynchronen Modus
+		Udb::Global* d_tri; // in Index-Db, nur mit Trigramm-Index
+		Udb::Global* d_pos; // in Index-Db, nur mit Positionen
+		Udb::Global* d_delta; // in Index-Db, Terme seit dem letzten writeTermFile
+		TermFile* d_terms; // angehaengte Kopie des Dictionary oder 0
+		PostingCache* d_postCache;
 		Udb::Transaction* d_txn; // in Daten-Db
 		QSet<Udb::Atom> d_typesToWatch, d_attrsToWatch; // wir brauchen Listen wegen erase
 		Tokenizer* d_tok;
 		Stemmer* d_ste;
 		Stopper* d_sto;
 		bool d_useReverseIndex;
+		bool d_useTrigramIndex;
+		bool d_usePositions;
 		bool d_resolveDocuments;
 		bool d_checkEmpty;
+		Terms* d_change; // waehrend processChange, siehe process
+		Udb::Obj d_changeObj;
+		QHash<quint32,QPair<qint32,qint64> > d_statDeltas; // RowFormat: ausstehende Aenderung von df und ttf
+		QHash<QByteArray,qint32> d_pending; // key2/key3 -> freq delta im Bulk-Modus
+		quint32 d_pendingSize; // geschaetzter Speicherbedarf von d_pending in Bytes
+		quint32 d_bulkLimit;
+		int d_bulkLevel;
+		QHash<QString,quint32> d_termCache; // stem -> id, 0..nicht im Dictionary
+		QSet<QString> d_revCache; // Terms, deren reverse Eintrag bereits geschrieben ist
+		QSet<QString> d_triCache; // Terms, deren Trigramme bereits geschrieben sind
+		quint32 d_termCacheSize;
+		quint32 d_termCacheLimit;
+		quint32 d_nextTerm, d_lastTerm; // reservierter, noch nicht vergebener Bereich von AttrMaxTerm
+		QMap<quint32,int> d_queued; // ticket -> Anzahl Eintraege in d_queue
+		int d_queueCount;
+		quint32 d_lastTicket;
+		bool d_async;
+		bool d_drainScheduled;
+		bool d_rebuildScheduled;
+		PostingFormat d_format;
+		Scoring d_scoring;
+		float d_k1, d_b;
+		quint32 d_expansionLimit;
+		quint32 d_dictGen; // zaehlt Aenderungen des Dictionary
+		mutable quint32 d_expansionGen; // d_dictGen, zu dem d_expansions gehoert
+		mutable QList<QPair<QByteArray,Expansion> > d_expansions; // Praefix -> Expansion, zuletzt verwendete zuerst
+		quint32 d_deltaCount; // Eintraege in d_delta
+		quint32 d_termRebuild;
+		struct CachedResult
+		{
+			HitList* d_hits;
+			quint64 d_tick; // Schluessel in d_resultLru
+			quint32 d_bytes;
+		};
+		quint32 d_indexGen; // zaehlt Aenderungen der Postings
+		quint32 d_resultLimit;
+		mutable quint32 d_resultGen; // d_indexGen, zu dem d_results gehoert
+		mutable quint32 d_resultSize;
+		mutable quint64 d_resultTick;
+		mutable quint32 d_resultHits, d_resultMisses;
+		mutable QHash<QString,CachedResult> d_results; // resultKey -> Resultat
+		mutable QMap<quint64,QString> d_resultLru; // aelteste zuerst
+		QHash<QString,Udb::Atom> d_queryFields; // siehe Query::Fields
+		mutable QReadWriteLock d_lock; // rekursiv; lesen fuer Abfragen, schreiben fuer Aenderungen des Index
+		mutable QMutex d_dbLock; // Udb-Zugriffe der Abfragen untereinander
+		mutable QMutex d_cacheLock; // d_expansions, d_results samt Zaehlern und d_postCache
+		mutable QMutex d_poolLock;
+		mutable QList<Stemmer*> d_stePool; // Klone von d_ste fuer Abfragen
+		mutable QList<Tokenizer*> d_tokPool; // Klone von d_tok fuer Abfragen
+		mutable QMutex d_readerLock;
+		mutable QList<Qt::HANDLE> d_readers; // Threads mit Reader, einmal pro Reader; nur Debug
 	};
 }
 
@@ -0,0 +1,153 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "PostingCache.h"
+using namespace Fts;
+
+static const quint32 s_entryOverhead = 96; // QHash-Node, QMap-Node und die Header der Arrays
+
+PostingCache::Sketch::Sketch():d_samples(0)
+{
+	d_table.fill( 0, Width * Depth );
+}
+
+int PostingCache::Sketch::index(quint32 tid, int row)
+{
+	// Multiplikative Hashes mit verschiedenen ungeraden Faktoren pro Zeile
+	static const quint32 s_seeds[Depth] = { 0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu };
+	const quint32 h = ( tid + 1 ) * s_seeds[row];
+	return row * Width + ( ( h ^ ( h >> 16 ) ) & ( Width - 1 ) );
+}
+
+void PostingCache::Sketch::increment(quint32 tid)
+{
+	for( int row = 0; row < Depth; row++ )
+	{
+		quint8& c = d_table[index( tid, row )];
+		if( c < 15 )
+			c++;
+	}
+	if( ++d_samples >= quint32( SampleFactor * Width ) )
+	{
+		// Altern: alte Haeufigkeiten verlieren an Gewicht
+		for( int i = 0; i < d_table.size(); i++ )
+			d_table[i] >>= 1;
+		d_samples /= 2;
+	}
+}
+
+quint8 PostingCache::Sketch::estimate(quint32 tid) const
+{
+	quint8 res = 15;
+	for( int row = 0; row < Depth; row++ )
+		res = qMin( res, d_table[index( tid, row )] );
+	return res;
+}
+
+void PostingCache::Sketch::clear()
+{
+	d_table.fill( 0 );
+	d_samples = 0;
+}
+
+PostingCache::PostingCache(quint32 limit):d_tick(0),d_limit(limit),d_size(0),d_hits(0),d_misses(0),d_rejected(0)
+{
+}
+
+quint32 PostingCache::byteSize(const HitList & l)
+{
+	return l.size() * ( sizeof(Udb::OID) + sizeof(quint32) + sizeof(int) ) +
+			l.itemCount() * ( sizeof(Udb::OID) + sizeof(quint32) ) + s_entryOverhead;
+}
+
+bool PostingCache::find(quint32 tid, HitList & res)
+{
+	d_sketch.increment( tid );
+	QHash<quint32,Entry>::iterator i = d_entries.find( tid );
+	if( i == d_entries.end() )
+	{
+		d_misses++;
+		return false;
+	}
+	d_hits++;
+	d_lru.remove( i.value().d_tick );
+	i.value().d_tick = ++d_tick;
+	d_lru.insert( i.value().d_tick, tid );
+	res = i.value().d_hits;
+	return true;
+}
+
+bool PostingCache::insert(quint32 tid, const HitList & l)
+{
+	const quint32 bytes = byteSize( l );
+	if( bytes > d_limit )
+		return false;
+	remove( tid );
+	// Zuerst pruefen, ob alle Opfer seltener gebraucht werden; erst dann verdraengen
+	const quint8 freq = d_sketch.estimate( tid );
+	QList<quint32> victims;
+	quint32 freed = 0;
+	QMap<quint64,quint32>::const_iterator j = d_lru.begin();
+	while( d_size - freed + bytes > d_limit && j != d_lru.end() )
+	{
+		if( d_sketch.estimate( j.value() ) >= freq )
+		{
+			d_rejected++;
+			return false;
+		}
+		victims.append( j.value() );
+		freed += d_entries.value( j.value() ).d_bytes;
+		++j;
+	}
+	foreach( quint32 v, victims )
+		remove( v );
+	Entry e;
+	e.d_hits = l;
+	e.d_tick = ++d_tick;
+	e.d_bytes = bytes;
+	d_entries.insert( tid, e );
+	d_lru.insert( e.d_tick, tid );
+	d_size += bytes;
+	return true;
+}
+
+void PostingCache::remove(quint32 tid)
+{
+	QHash<quint32,Entry>::iterator i = d_entries.find( tid );
+	if( i == d_entries.end() )
+		return;
+	d_lru.remove( i.value().d_tick );
+	d_size -= i.value().d_bytes;
+	d_entries.erase( i );
+}
+
+void PostingCache::clear()
+{
+	d_entries.clear();
+	d_lru.clear();
+	d_size = 0;
+	d_sketch.clear();
+}
+
+void PostingCache::setLimit(quint32 bytes)
+{
+	d_limit = bytes;
+	while( d_size > d_limit && !d_lru.isEmpty() )
+		remove( d_lru.begin().value() );
+}
@@ -0,0 +1,80 @@
+#ifndef POSTINGCACHE_H
+#define POSTINGCACHE_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "HitList.h"
+#include <QHash>
+#include <QMap>
+#include <QVector>
+
+namespace Fts
+{
+	// Dekodierte Postings pro Term-ID (rank ist die Haeufigkeit) mit einer Obergrenze in Bytes.
+	// Verdraengt wird der am laengsten nicht verwendete Eintrag, aber nur, wenn der neue Term nach einer
+	// Schaetzung der Zugriffshaeufigkeit oefter gebraucht wird als alle Eintraege, die dafuer Platz machen
+	// muessten (TinyLFU nach Einziger/Friedman 2017). So verdraengen einmalige Abfragen die haeufigen Terme nicht.
+	class PostingCache
+	{
+	public:
+		PostingCache( quint32 limit );
+		bool find( quint32 tid, HitList& ); // zaehlt auch den Zugriff
+		bool insert( quint32 tid, const HitList& ); // false..nicht aufgenommen
+		void remove( quint32 tid );
+		void clear();
+		void setLimit( quint32 bytes );
+		quint32 getLimit() const { return d_limit; }
+		quint32 getSize() const { return d_size; }
+		quint32 getHits() const { return d_hits; }
+		quint32 getMisses() const { return d_misses; }
+		quint32 getRejected() const { return d_rejected; }
+		static quint32 byteSize( const HitList& );
+	private:
+		// Count-Min-Sketch mit 4-bit Zaehlern; nach SampleFactor * Breite Zugriffen werden alle halbiert
+		class Sketch
+		{
+		public:
+			enum { Width = 4096, Depth = 4, SampleFactor = 10 };
+			Sketch();
+			void increment( quint32 );
+			quint8 estimate( quint32 ) const;
+			void clear();
+		private:
+			static int index( quint32, int row );
+			QVector<quint8> d_table; // Depth Zeilen zu Width Zaehlern
+			quint32 d_samples;
+		};
+		struct Entry
+		{
+			HitList d_hits;
+			quint64 d_tick; // Schluessel in d_lru
+			quint32 d_bytes;
+		};
+		QHash<quint32,Entry> d_entries;
+		QMap<quint64,quint32> d_lru; // aelteste zuerst
+		Sketch d_sketch;
+		quint64 d_tick;
+		quint32 d_limit;
+		quint32 d_size;
+		quint32 d_hits, d_misses, d_rejected;
+	};
+}
+
+#endif // POSTINGCACHE_H
@@ -0,0 +1,258 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "Postings.h"
+#include "HitList.h"
+using namespace Fts;
+
+// Innerhalb der Zellen wird ein einfaches LEB128 verwendet; es muss im Gegensatz zu den Schluesseln
+// nicht sortierbar sein und ist schneller zu dekodieren als der Weg ueber QBuffer.
+
+static inline void _write( QByteArray& out, quint64 v )
+{
+	while( v >= 0x80 )
+	{
+		out.append( char( ( v & 0x7f ) | 0x80 ) );
+		v >>= 7;
+	}
+	out.append( char( v ) );
+}
+
+static inline quint64 _read( const char*& p, const char* end, int maxBytes = 10 )
+{
+	// Hoechstens maxBytes, damit ein beschaedigter Wert nicht ueber die Bits des Typs hinaus schiebt
+	quint64 v = 0;
+	for( int i = 0; i < maxBytes && p < end; i++ )
+	{
+		const quint8 b = quint8( *p++ );
+		v |= quint64( b & 0x7f ) << ( 7 * i );
+		if( ( b & 0x80 ) == 0 )
+			break;
+	}
+	return v;
+}
+
+static inline quint32 _read32( const char*& p, const char* end )
+{
+	return quint32( _read( p, end, 5 ) );
+}
+
+static void _writeRefs( QByteArray& out, const PostingCodec::BlockDir& refs, int from, int to )
+{
+	_write( out, to - from );
+	Udb::OID prev = 0;
+	for( int i = from; i < to; i++ )
+	{
+		const PostingCodec::BlockRef& b = refs[i];
+		_write( out, b.d_no );
+		_write( out, b.d_first - prev );
+		_write( out, b.d_last - b.d_first );
+		_write( out, b.d_count );
+		_write( out, b.d_maxFreq );
+		prev = b.d_last;
+	}
+}
+
+static void _readRefs( const char*& p, const char* end, PostingCodec::BlockDir& refs )
+{
+	const quint32 n = _read32( p, end );
+	Udb::OID prev = 0;
+	for( quint32 i = 0; i < n && p < end; i++ )
+	{
+		PostingCodec::BlockRef b;
+		b.d_no = _read32( p, end );
+		b.d_first = prev + _read( p, end );
+		b.d_last = b.d_first + _read( p, end );
+		b.d_count = _read32( p, end );
+		b.d_maxFreq = _read32( p, end );
+		prev = b.d_last;
+		refs.append( b );
+	}
+}
+
+QByteArray PostingCodec::writeHead(const Head & h)
+{
+	Q_ASSERT( h.d_blocks.isEmpty() );
+	QByteArray out;
+	out.reserve( 16 + h.d_pages.size() * 8 );
+	// 0 kann bei aelteren Koepfen nicht am Anfang stehen, da d_nextNo dort mindestens 1 ist
+	out.append( char(0) );
+	_write( out, h.d_nextNo );
+	_write( out, h.d_ttf );
+	_writeRefs( out, h.d_pages, 0, h.d_pages.size() );
+	return out;
+}
+
+bool PostingCodec::readHead(const QByteArray & in, Head & h)
+{
+	h.d_pages.clear();
+	h.d_blocks.clear();
+	h.d_nextNo = 1;
+	h.d_ttf = 0;
+	if( in.isEmpty() )
+		return false;
+	const char* p = in.constData();
+	const char* end = p + in.size();
+	if( *p == 0 )
+	{
+		p++;
+		h.d_nextNo = _read32( p, end );
+		h.d_ttf = _read( p, end );
+		_readRefs( p, end, h.d_pages );
+		return true;
+	}
+	// aelterer Kopf mit dem ganzen Verzeichnis, wird beim naechsten Schreiben in Seiten aufgeteilt
+	h.d_nextNo = _read32( p, end );
+	_readRefs( p, end, h.d_blocks );
+	if( p < end )
+		h.d_ttf = _read( p, end ); // fehlt bei noch aelteren Koepfen
+	return true;
+}
+
+QByteArray PostingCodec::writePage(const BlockDir & dir, int from, int to)
+{
+	QByteArray out;
+	out.reserve( 4 + ( to - from ) * 8 );
+	_writeRefs( out, dir, from, to );
+	return out;
+}
+
+void PostingCodec::readPage(const QByteArray & in, BlockDir & dir)
+{
+	const char* p = in.constData();
+	_readRefs( p, p + in.size(), dir );
+}
+
+PostingCodec::PageRef PostingCodec::makePage(const BlockDir & dir, int from, int to, quint32 no)
+{
+	Q_ASSERT( from < to );
+	PageRef r;
+	r.d_no = no;
+	r.d_first = dir[from].d_first;
+	r.d_last = dir[to-1].d_last;
+	r.d_count = 0;
+	r.d_maxFreq = 0;
+	for( int i = from; i < to; i++ )
+	{
+		r.d_count += dir[i].d_count;
+		r.d_maxFreq = qMax( r.d_maxFreq, dir[i].d_maxFreq );
+	}
+	return r;
+}
+
+QByteArray PostingCodec::writeBlock(const IndexEngine::DocHits & docs, int from, int to)
+{
+	QByteArray out;
+	out.reserve( ( to - from ) * 4 );
+	_write( out, to - from );
+	Udb::OID prev = 0;
+	for( int i = from; i < to; i++ )
+	{
+		const IndexEngine::DocHit& d = docs[i];
+		_write( out, d.d_doc - prev );
+		_write( out, d.d_rank );
+		_write( out, d.d_items.size() );
+		Udb::OID prevItem = 0;
+		for( int j = 0; j < d.d_items.size(); j++ )
+		{
+			_write( out, d.d_items[j].d_item - prevItem );
+			_write( out, d.d_items[j].d_rank );
+			prevItem = d.d_items[j].d_item;
+		}
+		prev = d.d_doc;
+	}
+	return out;
+}
+
+void PostingCodec::readBlock(const QByteArray & in, IndexEngine::DocHits & docs)
+{
+	const char* p = in.constData();
+	const char* end = p + in.size();
+	const quint32 n = _read32( p, end );
+	docs.reserve( docs.size() + int( qMin( n, quint32( in.size() ) ) ) ); // jedes Doc braucht mindestens ein Byte
+	Udb::OID prev = 0;
+	for( quint32 i = 0; i < n && p < end; i++ )
+	{
+		IndexEngine::DocHit d;
+		d.d_doc = prev + _read( p, end );
+		d.d_rank = _read32( p, end );
+		const quint32 items = _read32( p, end );
+		Udb::OID prevItem = 0;
+		for( quint32 j = 0; j < items && p < end; j++ )
+		{
+			IndexEngine::ItemHit h;
+			h.d_item = prevItem + _read( p, end );
+			h.d_rank = _read32( p, end );
+			d.d_items.append( h );
+			prevItem = h.d_item;
+		}
+		prev = d.d_doc;
+		docs.append( d );
+	}
+}
+
+void PostingCodec::readBlock(const QByteArray & in, HitList & hits)
+{
+	const char* p = in.constData();
+	const char* end = p + in.size();
+	const quint32 n = _read32( p, end );
+	Udb::OID prev = 0;
+	for( quint32 i = 0; i < n && p < end; i++ )
+	{
+		const Udb::OID doc = prev + _read( p, end );
+		hits.appendDoc( doc, _read32( p, end ) );
+		const quint32 items = _read32( p, end );
+		Udb::OID prevItem = 0;
+		for( quint32 j = 0; j < items && p < end; j++ )
+		{
+			prevItem += _read( p, end );
+			hits.appendItem( prevItem, _read32( p, end ) );
+		}
+		prev = doc;
+	}
+}
+
+PostingCodec::BlockRef PostingCodec::makeRef(const IndexEngine::DocHits & docs, int from, int to, quint32 no)
+{
+	Q_ASSERT( from < to );
+	BlockRef b;
+	b.d_no = no;
+	b.d_first = docs[from].d_doc;
+	b.d_last = docs[to-1].d_doc;
+	b.d_count = to - from;
+	b.d_maxFreq = 0;
+	for( int i = from; i < to; i++ )
+		b.d_maxFreq = qMax( b.d_maxFreq, docs[i].d_rank );
+	return b;
+}
+
+int PostingCodec::findBlock(const BlockDir & dir, Udb::OID doc, int from)
+{
+	// binaere Suche; das Verzeichnis ist nach OID geordnet und die Bloecke ueberlappen nicht
+	int lo = from, hi = dir.size();
+	while( lo < hi )
+	{
+		const int mid = ( lo + hi ) / 2;
+		if( dir[mid].d_last < doc )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
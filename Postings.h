@@ -0,0 +1,69 @@
+#ifndef POSTINGS_H
+#define POSTINGS_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "IndexEngine.h"
+
+namespace Fts
+{
+	// Block-Format der Postings: pro Term eine Kopfzelle, Seiten mit je bis zu MaxPage Eintraegen des
+	// Blockverzeichnisses (Skip-Daten) und Bloecke mit je bis zu MaxBlock delta-kodierten Doc-OIDs samt
+	// Haeufigkeiten und ItemHits. Der Kopf fasst jede Seite zusammen, so dass eine Aenderung nur den Kopf,
+	// die betroffene Seite und den betroffenen Block neu schreibt. Seiten und Bloecke teilen sich die
+	// Nummern; die Reihenfolge ergibt sich aus dem Kopf bzw. der Seite, nicht aus der Nummer.
+	class PostingCodec
+	{
+	public:
+		enum { BlockSize = 128, MaxBlock = 2 * BlockSize, PageSize = 64, MaxPage = 2 * PageSize };
+		struct BlockRef
+		{
+			Udb::OID d_first;
+			Udb::OID d_last;
+			quint32 d_no;    // Teil des Schluessels der Blockzelle
+			quint32 d_count; // Anzahl Docs im Block
+			quint32 d_maxFreq;
+		};
+		typedef QList<BlockRef> BlockDir;
+		typedef BlockRef PageRef; // d_count und d_maxFreq ueber alle Bloecke der Seite
+		typedef QList<PageRef> PageDir;
+		struct Head
+		{
+			quint32 d_nextNo;
+			PageDir d_pages; // geordnet nach OID
+			BlockDir d_blocks; // nur aeltere Koepfe mit dem ganzen Verzeichnis, sonst leer
+			quint64 d_ttf; // Summe der Haeufigkeiten; df ist die Summe der d_count
+			Head():d_nextNo(1),d_ttf(0) {}
+		};
+
+		static QByteArray writeHead( const Head& );
+		static bool readHead( const QByteArray&, Head& );
+		static QByteArray writePage( const BlockDir&, int from, int to );
+		static void readPage( const QByteArray&, BlockDir& ); // haengt an
+		static PageRef makePage( const BlockDir&, int from, int to, quint32 no );
+		static QByteArray writeBlock( const IndexEngine::DocHits&, int from, int to );
+		static void readBlock( const QByteArray&, IndexEngine::DocHits& ); // haengt an
+		static void readBlock( const QByteArray&, HitList& ); // haengt an
+		static BlockRef makeRef( const IndexEngine::DocHits&, int from, int to, quint32 no );
+		static int findBlock( const BlockDir&, Udb::OID doc, int from = 0 ); // erster Block mit d_last >= doc
+	};
+}
+
+#endif // POSTINGS_H
@@ -0,0 +1,369 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "Query.h"
+#include <QStringList>
+using namespace Fts;
+
+Query::Query():d_pos(0),d_tok(TokEnd),d_tokPos(0),d_distance(-1),d_field(0),d_root(0)
+{
+}
+
+Query::~Query()
+{
+	delete d_root;
+}
+
+bool Query::parse(const QString & str, const Fields & fields)
+{
+	delete d_root;
+	d_root = 0;
+	d_error.clear();
+	d_str = str;
+	d_pos = 0;
+	d_fields = fields;
+	nextToken();
+	if( d_tok == TokEnd )
+		return true;
+	QueryNode* n = parseOr( 0, 0 );
+	if( n == 0 )
+		return false;
+	if( d_tok != TokEnd )
+	{
+		delete n;
+		return error( QString("unexpected '%1'").arg( d_str.mid( d_tokPos, d_pos - d_tokPos ) ) );
+	}
+	n = simplify( n );
+	if( !check( n ) )
+	{
+		delete n;
+		return false;
+	}
+	d_root = n;
+	return true;
+}
+
+bool Query::error(const QString & msg)
+{
+	// die erste Meldung gilt, die weiteren sind nur Folgefehler
+	if( d_error.isEmpty() )
+		d_error = QString("%1 at %2").arg( msg ).arg( d_tokPos );
+	return false;
+}
+
+void Query::nextToken()
+{
+	while( d_pos < d_str.size() && d_str[d_pos].isSpace() )
+		d_pos++;
+	d_tokPos = d_pos;
+	d_text.clear();
+	d_distance = -1;
+	if( d_pos >= d_str.size() )
+	{
+		d_tok = TokEnd;
+		return;
+	}
+	const QChar ch = d_str[d_pos];
+	if( ch == QChar('(') || ch == QChar(')') )
+	{
+		d_pos++;
+		d_tok = ( ch == QChar('(') ) ? TokLPar : TokRPar;
+		return;
+	}
+	if( ch == QChar('"') )
+	{
+		const int end = d_str.indexOf( QChar('"'), d_pos + 1 );
+		if( end < 0 )
+		{
+			d_tok = TokError;
+			error( "missing '\"'" );
+			return;
+		}
+		d_text = d_str.mid( d_pos + 1, end - d_pos - 1 );
+		d_pos = end + 1;
+		d_tok = TokQuote;
+		if( d_pos < d_str.size() && d_str[d_pos] == QChar('~') )
+		{
+			int n = ++d_pos;
+			while( n < d_str.size() && d_str[n].isDigit() )
+				n++;
+			bool ok = n > d_pos;
+			if( ok )
+				d_distance = d_str.mid( d_pos, n - d_pos ).toInt( &ok );
+			d_pos = n;
+			if( !ok )
+			{
+				d_tok = TokError;
+				error( "number expected after '~'" );
+			}
+		}
+		return;
+	}
+	if( ch == QChar('-') && d_pos + 1 < d_str.size() && !d_str[d_pos + 1].isSpace() )
+	{
+		d_pos++;
+		d_tok = TokNot;
+		return;
+	}
+	int end = d_pos;
+	while( end < d_str.size() && !d_str[end].isSpace() && d_str[end] != QChar('(') &&
+		   d_str[end] != QChar(')') && d_str[end] != QChar('"') )
+		end++;
+	const QString word = d_str.mid( d_pos, end - d_pos );
+	const int colon = word.indexOf( QChar(':') );
+	if( colon > 0 && word[0].isLetter() )
+	{
+		const QString name = word.left( colon ).toLower();
+		if( d_fields.contains( name ) )
+		{
+			d_field = d_fields.value( name );
+			d_pos += colon + 1;
+			d_tok = TokField;
+			return;
+		}
+		bool ident = true;
+		for( int i = 0; i < name.size() && ident; i++ )
+			ident = name[i].isLetterOrNumber() || name[i] == QChar('_');
+		if( ident )
+		{
+			d_tok = TokError;
+			error( QString("unknown field '%1'").arg( name ) );
+			return;
+		}
+	}
+	d_pos = end;
+	if( word == QLatin1String("AND") || word == QLatin1String("&&") )
+		d_tok = TokAnd;
+	else if( word == QLatin1String("OR") || word == QLatin1String("||") )
+		d_tok = TokOr;
+	else if( word == QLatin1String("NOT") )
+		d_tok = TokNot;
+	else
+	{
+		d_tok = TokWord;
+		d_text = word;
+	}
+}
+
+QueryNode *Query::parseOr(Udb::Atom field, int depth)
+{
+	QueryNode* res = new QueryNode( QueryNode::Or );
+	while( true )
+	{
+		QueryNode* n = parseAnd( field, depth );
+		if( n == 0 )
+		{
+			delete res;
+			return 0;
+		}
+		res->d_subs.append( n );
+		if( d_tok != TokOr )
+			return res; // einzelne Operanden entfernt simplify
+		nextToken();
+	}
+}
+
+QueryNode *Query::parseAnd(Udb::Atom field, int depth)
+{
+	QueryNode* res = new QueryNode( QueryNode::And );
+	while( true )
+	{
+		QueryNode* n = parseUnary( field, depth );
+		if( n == 0 )
+		{
+			delete res;
+			return 0;
+		}
+		res->d_subs.append( n );
+		if( d_tok == TokAnd )
+			nextToken();
+		else if( d_tok != TokWord && d_tok != TokQuote && d_tok != TokField && d_tok != TokLPar && d_tok != TokNot )
+			return res;
+	}
+}
+
+QueryNode *Query::parseUnary(Udb::Atom field, int depth)
+{
+	if( depth > MaxDepth )
+	{
+		error( "query nested too deeply" );
+		return 0;
+	}
+	if( d_tok != TokNot )
+		return parsePrimary( field, depth );
+	nextToken();
+	QueryNode* sub = parseUnary( field, depth + 1 );
+	if( sub == 0 )
+		return 0;
+	QueryNode* res = new QueryNode( QueryNode::Not );
+	res->d_subs.append( sub );
+	return res;
+}
+
+QueryNode *Query::parsePrimary(Udb::Atom field, int depth)
+{
+	QueryNode* res = 0;
+	switch( d_tok )
+	{
+	case TokLPar:
+		nextToken();
+		res = parseOr( field, depth + 1 );
+		if( res == 0 )
+			return 0;
+		if( d_tok != TokRPar )
+		{
+			delete res;
+			error( "missing ')'" );
+			return 0;
+		}
+		nextToken();
+		return res;
+	case TokField:
+		{
+			if( field != 0 )
+			{
+				error( "nested field" );
+				return 0;
+			}
+			const Udb::Atom f = d_field;
+			nextToken();
+			return parsePrimary( f, depth + 1 );
+		}
+	case TokWord:
+		res = new QueryNode( QueryNode::Term );
+		break;
+	case TokQuote:
+		if( d_text.trimmed().isEmpty() )
+		{
+			error( "empty phrase" );
+			return 0;
+		}
+		res = new QueryNode( ( d_distance < 0 ) ? QueryNode::Phrase : QueryNode::Near );
+		res->d_distance = qMax( d_distance, 0 );
+		break;
+	case TokError:
+		return 0;
+	case TokEnd:
+		error( "unexpected end" );
+		return 0;
+	default:
+		error( QString("unexpected '%1'").arg( d_str.mid( d_tokPos, d_pos - d_tokPos ) ) );
+		return 0;
+	}
+	res->d_text = d_text;
+	res->d_field = field;
+	nextToken();
+	return res;
+}
+
+QueryNode *Query::simplify(QueryNode * n)
+{
+	for( int i = 0; i < n->d_subs.size(); i++ )
+		n->d_subs[i] = simplify( n->d_subs[i] );
+	if( n->d_op == QueryNode::Not && n->d_subs.first()->d_op == QueryNode::Not )
+	{
+		QueryNode* res = n->d_subs.first()->d_subs.takeFirst();
+		delete n;
+		return res;
+	}
+	if( n->d_op == QueryNode::And || n->d_op == QueryNode::Or )
+	{
+		QList<QueryNode*> subs;
+		foreach( QueryNode* s, n->d_subs )
+		{
+			if( s->d_op == n->d_op )
+			{
+				subs += s->d_subs;
+				s->d_subs.clear();
+				delete s;
+			}else
+				subs.append( s );
+		}
+		n->d_subs = subs;
+		if( n->d_subs.size() == 1 )
+		{
+			QueryNode* res = n->d_subs.takeFirst();
+			delete n;
+			return res;
+		}
+	}
+	return n;
+}
+
+bool Query::check(const QueryNode * n)
+{
+	// NOT ist nur als Einschraenkung einer Konjunktion auswertbar, nicht gegen alle Docs
+	switch( n->d_op )
+	{
+	case QueryNode::Not:
+		d_error = "NOT needs a positive term in the same conjunction";
+		return false;
+	case QueryNode::And:
+		{
+			bool positive = false;
+			foreach( const QueryNode* s, n->d_subs )
+			{
+				if( s->d_op != QueryNode::Not )
+					positive = true;
+				if( !check( ( s->d_op == QueryNode::Not ) ? s->d_subs.first() : s ) )
+					return false;
+			}
+			if( !positive )
+			{
+				d_error = "NOT needs a positive term in the same conjunction";
+				return false;
+			}
+		}
+		return true;
+	case QueryNode::Or:
+		foreach( const QueryNode* s, n->d_subs )
+		{
+			if( !check( s ) )
+				return false;
+		}
+		return true;
+	default:
+		return true;
+	}
+}
+
+QString Query::toString(const QueryNode * n)
+{
+	if( n == 0 )
+		return QString();
+	const QString field = ( n->d_field != 0 ) ? QString("%1:").arg( n->d_field ) : QString();
+	switch( n->d_op )
+	{
+	case QueryNode::Term:
+		return field + n->d_text;
+	case QueryNode::Phrase:
+		return field + QChar('"') + n->d_text + QChar('"');
+	case QueryNode::Near:
+		return field + QChar('"') + n->d_text + QString("\"~%1").arg( n->d_distance );
+	case QueryNode::Not:
+		return QLatin1String("NOT ") + toString( n->d_subs.first() );
+	default:
+		{
+			QStringList subs;
+			foreach( const QueryNode* s, n->d_subs )
+				subs.append( toString( s ) );
+			return QChar('(') + subs.join( ( n->d_op == QueryNode::And ) ? " AND " : " OR " ) + QChar(')');
+		}
+	}
+}
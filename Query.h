@@ -0,0 +1,88 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <Udb/Obj.h>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+namespace Fts
+{
+	// Knoten im Operatorbaum einer Abfrage; besitzt die Unterknoten
+	class QueryNode
+	{
+	public:
+		enum Op { Term, Phrase, Near, And, Or, Not };
+		QueryNode( Op op ):d_op(op),d_field(0),d_distance(0) {}
+		~QueryNode() { qDeleteAll( d_subs ); }
+		Op d_op;
+		QString d_text; // Term, Phrase und Near
+		Udb::Atom d_field; // 0..alle Felder
+		int d_distance; // nur Near
+		QList<QueryNode*> d_subs; // And, Or und Not
+	};
+
+	// Parser fuer die Abfragesprache von IndexEngine::findQuery:
+	//   a b, a AND b   beide; AND ist implizit und bindet staerker als OR
+	//   a OR b         mindestens einer
+	//   NOT a, -a      ohne a; nur in einer Konjunktion mit mindestens einem positiven Teil
+	//   ( ... )        Gruppierung
+	//   "a b"          Phrase; "a b"~3 sind beide Terme mit hoechstens 3 Tokens dazwischen
+	//   feld:a         nur im Feld mit diesem Namen, ebenso feld:"a b" und feld:( ... )
+	//   ab*, a?c       Joker
+	// Der Baum wird vereinfacht: verschachtelte AND bzw. OR werden flach, doppeltes NOT faellt weg.
+	// Die Kosten und die Reihenfolge der Auswertung bestimmt erst IndexEngine.
+	class Query
+	{
+	public:
+		typedef QHash<QString,Udb::Atom> Fields; // kleingeschriebener Name -> Attribut
+		enum { MaxDepth = 64 }; // Schachtelung von Klammern und NOT
+		Query();
+		~Query();
+		bool parse( const QString&, const Fields& = Fields() ); // false mit getError
+		const QueryNode* getRoot() const { return d_root; } // 0 bei leerer Abfrage
+		const QString& getError() const { return d_error; }
+		static QString toString( const QueryNode* ); // kanonische Form mit Klammern, z.B. zum Debuggen
+	private:
+		enum Token { TokEnd, TokWord, TokQuote, TokField, TokLPar, TokRPar, TokAnd, TokOr, TokNot, TokError };
+		void nextToken();
+		QueryNode* parseOr( Udb::Atom field, int depth );
+		QueryNode* parseAnd( Udb::Atom field, int depth );
+		QueryNode* parseUnary( Udb::Atom field, int depth );
+		QueryNode* parsePrimary( Udb::Atom field, int depth );
+		bool error( const QString& );
+		bool check( const QueryNode* );
+		static QueryNode* simplify( QueryNode* );
+		QString d_str;
+		int d_pos; // naechstes Zeichen in d_str
+		Token d_tok;
+		int d_tokPos;
+		QString d_text; // TokWord und TokQuote
+		int d_distance; // TokQuote mit ~, sonst -1
+		Udb::Atom d_field; // TokField
+		Fields d_fields;
+		QueryNode* d_root;
+		QString d_error;
+	};
+}
+
+#endif // QUERY_H
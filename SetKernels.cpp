@@ -0,0 +1,390 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "SetKernels.h"
+#include <string.h>
+using namespace Fts;
+
+// Die SIMD-Varianten werden ohne spezielle Compiler-Flags uebersetzt; GCC/Clang erhalten das Zielsystem
+// pro Funktion, MSVC erlaubt die Intrinsics ohnehin. Ausserhalb x86 bleibt nur die skalare Variante.
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define FTS_X86
+#define FTS_AVX2 __attribute__((target("avx2")))
+#define FTS_SSE42 __attribute__((target("sse4.2")))
+#include <immintrin.h>
+static inline int _ctz( unsigned int v ) { return __builtin_ctz( v ); }
+#elif defined(_MSC_VER) && ( defined(_M_X64) || defined(_M_IX86) )
+#define FTS_X86
+#define FTS_AVX2
+#define FTS_SSE42
+#include <immintrin.h>
+#include <intrin.h>
+static inline int _ctz( unsigned int v ) { unsigned long i; _BitScanForward( &i, v ); return i; }
+#endif
+
+static SetKernels::Isa _detect()
+{
+#if defined(FTS_X86) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx2" ) )
+		return SetKernels::Avx2;
+	if( __builtin_cpu_supports( "sse4.2" ) )
+		return SetKernels::Sse42;
+#elif defined(FTS_X86)
+	int info[4];
+	__cpuid( info, 0 );
+	const int maxLeaf = info[0];
+	__cpuid( info, 1 );
+	const bool sse42 = ( info[2] & ( 1 << 20 ) ) != 0;
+	const bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+	if( maxLeaf >= 7 && osxsave && ( _xgetbv( 0 ) & 6 ) == 6 )
+	{
+		__cpuidex( info, 7, 0 );
+		if( info[1] & ( 1 << 5 ) )
+			return SetKernels::Avx2;
+	}
+	if( sse42 )
+		return SetKernels::Sse42;
+#endif
+	return SetKernels::Scalar;
+}
+
+static SetKernels::Isa _maxIsa()
+{
+	static const SetKernels::Isa s_max = _detect();
+	return s_max;
+}
+
+static int s_forced = SetKernels::Avx2;
+
+SetKernels::Isa SetKernels::isa()
+{
+	return Isa( qMin( int( _maxIsa() ), s_forced ) );
+}
+
+void SetKernels::forceIsa(SetKernels::Isa i)
+{
+	s_forced = i;
+}
+
+// Die Ausgabe ist von den Kernels getrennt; diese melden nur Positionen, gleiche Elemente mit both(),
+// Laeufe nur in a bzw. b vorhandener Elemente mit left() bzw. right().
+
+struct _PosOut
+{
+	int* d_ia;
+	int* d_ib;
+	inline void both( int i, int j, int n ) { d_ia[n] = i; d_ib[n] = j; }
+	inline void left( int i, int k, int n )
+	{
+		for( int x = 0; x < k; x++ )
+		{
+			d_ia[n + x] = i + x;
+			d_ib[n + x] = -1;
+		}
+	}
+	inline void right( int j, int k, int n )
+	{
+		for( int x = 0; x < k; x++ )
+		{
+			d_ia[n + x] = -1;
+			d_ib[n + x] = j + x;
+		}
+	}
+};
+
+struct _RankOut
+{
+	const quint64* d_a;
+	const quint32* d_ra;
+	const quint64* d_b;
+	const quint32* d_rb;
+	quint64* d_out;
+	quint32* d_rout;
+	inline void both( int i, int j, int n )
+	{
+		d_out[n] = d_a[i];
+		d_rout[n] = d_ra[i] + d_rb[j]; // RISK
+	}
+	inline void left( int i, int k, int n )
+	{
+		::memcpy( d_out + n, d_a + i, k * sizeof(quint64) );
+		::memcpy( d_rout + n, d_ra + i, k * sizeof(quint32) );
+	}
+	inline void right( int j, int k, int n )
+	{
+		::memcpy( d_out + n, d_b + j, k * sizeof(quint64) );
+		::memcpy( d_rout + n, d_rb + j, k * sizeof(quint32) );
+	}
+};
+
+template<class E>
+static inline int _intersectScalar( const quint64* a, int i, int na, const quint64* b, int j, int nb, E& e, int n )
+{
+	while( i < na && j < nb )
+	{
+		if( a[i] < b[j] )
+			i++;
+		else if( b[j] < a[i] )
+			j++;
+		else
+			e.both( i++, j++, n++ );
+	}
+	return n;
+}
+
+template<class E>
+static inline void _emitBlock( const quint64* a, int i, const quint64* b, int j, int mask, E& e, int& n )
+{
+	// mask enthaelt die Lanes von a mit einem Treffer im Block von b; da beide Bloecke sortiert sind,
+	// ist die Position in b mit einem fortlaufenden Index billig zu finden
+	int l = 0;
+	while( mask )
+	{
+		const int k = _ctz( mask );
+		mask &= mask - 1;
+		while( b[j + l] != a[i + k] )
+			l++;
+		e.both( i + k, j + l, n++ );
+	}
+}
+
+// Laenge des Laufs ab a[i] mit Elementen < pivot, wobei a[i] < pivot bekannt ist. Bei gemischten Listen
+// sind kurze Laeufe die Regel; erst ab dem vierten Element lohnt sich der Vektorvergleich.
+static inline int _probeRun( const quint64* a, int i, int na, quint64 pivot )
+{
+	const int probe = qMin( na, i + 4 );
+	int k = i + 1;
+	while( k < probe && a[k] < pivot )
+		k++;
+	return k;
+}
+
+static int _tailScalar( const quint64* a, int k, int na, quint64 pivot )
+{
+	while( k < na && a[k] < pivot )
+		k++;
+	return k;
+}
+
+template<class E, int (*tail)( const quint64*, int, int, quint64 )>
+static inline int _uniteRuns( const quint64* a, int na, const quint64* b, int nb, E& e )
+{
+	int i = 0, j = 0, n = 0;
+	while( i < na && j < nb )
+	{
+		if( a[i] < b[j] )
+		{
+			int k = _probeRun( a, i, na, b[j] );
+			if( k == i + 4 )
+				k = tail( a, k, na, b[j] );
+			e.left( i, k - i, n );
+			n += k - i;
+			i = k;
+		}else if( b[j] < a[i] )
+		{
+			int k = _probeRun( b, j, nb, a[i] );
+			if( k == j + 4 )
+				k = tail( b, k, nb, a[i] );
+			e.right( j, k - j, n );
+			n += k - j;
+			j = k;
+		}else
+			e.both( i++, j++, n++ );
+	}
+	if( i < na )
+	{
+		e.left( i, na - i, n );
+		n += na - i;
+	}
+	if( j < nb )
+	{
+		e.right( j, nb - j, n );
+		n += nb - j;
+	}
+	return n;
+}
+
+#ifdef FTS_X86
+
+// Block-Vergleich nach Schlegel/Lemire: je vier Elemente von a gegen alle Rotationen von vier Elementen
+// aus b; weiter geht es mit dem Block, dessen groesstes Element kleiner oder gleich ist.
+template<class E>
+FTS_AVX2 static int _intersectAvx2( const quint64* a, int na, const quint64* b, int nb, E& e )
+{
+	int i = 0, j = 0, n = 0;
+	while( i + 4 <= na && j + 4 <= nb )
+	{
+		const __m256i va = _mm256_loadu_si256( (const __m256i*)( a + i ) );
+		const __m256i vb = _mm256_loadu_si256( (const __m256i*)( b + j ) );
+		__m256i m = _mm256_cmpeq_epi64( va, vb );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x39 ) ) );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x4e ) ) );
+		m = _mm256_or_si256( m, _mm256_cmpeq_epi64( va, _mm256_permute4x64_epi64( vb, 0x93 ) ) );
+		const int mask = _mm256_movemask_pd( _mm256_castsi256_pd( m ) );
+		if( mask )
+			_emitBlock( a, i, b, j, mask, e, n );
+		const quint64 amax = a[i + 3];
+		const quint64 bmax = b[j + 3];
+		i += ( amax <= bmax ) << 2;
+		j += ( bmax <= amax ) << 2;
+	}
+	return _intersectScalar( a, i, na, b, j, nb, e, n );
+}
+
+template<class E>
+FTS_SSE42 static int _intersectSse42( const quint64* a, int na, const quint64* b, int nb, E& e )
+{
+	int i = 0, j = 0, n = 0;
+	while( i + 4 <= na && j + 4 <= nb )
+	{
+		const __m128i a0 = _mm_loadu_si128( (const __m128i*)( a + i ) );
+		const __m128i a1 = _mm_loadu_si128( (const __m128i*)( a + i + 2 ) );
+		const __m128i b0 = _mm_loadu_si128( (const __m128i*)( b + j ) );
+		const __m128i b1 = _mm_loadu_si128( (const __m128i*)( b + j + 2 ) );
+		const __m128i s0 = _mm_shuffle_epi32( b0, 0x4e );
+		const __m128i s1 = _mm_shuffle_epi32( b1, 0x4e );
+		const __m128i m0 = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi64( a0, b0 ), _mm_cmpeq_epi64( a0, s0 ) ),
+										 _mm_or_si128( _mm_cmpeq_epi64( a0, b1 ), _mm_cmpeq_epi64( a0, s1 ) ) );
+		const __m128i m1 = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi64( a1, b0 ), _mm_cmpeq_epi64( a1, s0 ) ),
+										 _mm_or_si128( _mm_cmpeq_epi64( a1, b1 ), _mm_cmpeq_epi64( a1, s1 ) ) );
+		const int mask = _mm_movemask_pd( _mm_castsi128_pd( m0 ) ) |
+				( _mm_movemask_pd( _mm_castsi128_pd( m1 ) ) << 2 );
+		if( mask )
+			_emitBlock( a, i, b, j, mask, e, n );
+		const quint64 amax = a[i + 3];
+		const quint64 bmax = b[j + 3];
+		i += ( amax <= bmax ) << 2;
+		j += ( bmax <= amax ) << 2;
+	}
+	return _intersectScalar( a, i, na, b, j, nb, e, n );
+}
+
+// cmpgt ist vorzeichenbehaftet; mit gekipptem Vorzeichenbit vergleichen sich die OIDs vorzeichenlos.
+// Da a sortiert ist, bilden die Treffer ein Praefix der Maske.
+
+FTS_AVX2 static int _tailAvx2( const quint64* a, int k, int na, quint64 pivot )
+{
+	const __m256i bias = _mm256_set1_epi64x( qint64( Q_UINT64_C( 0x8000000000000000 ) ) );
+	const __m256i p = _mm256_xor_si256( _mm256_set1_epi64x( qint64( pivot ) ), bias );
+	while( k + 4 <= na )
+	{
+		const __m256i v = _mm256_xor_si256( _mm256_loadu_si256( (const __m256i*)( a + k ) ), bias );
+		const int mask = _mm256_movemask_pd( _mm256_castsi256_pd( _mm256_cmpgt_epi64( p, v ) ) );
+		if( mask != 0xf )
+			return k + _ctz( ~mask );
+		k += 4;
+	}
+	return _tailScalar( a, k, na, pivot );
+}
+
+FTS_SSE42 static int _tailSse42( const quint64* a, int k, int na, quint64 pivot )
+{
+	const __m128i bias = _mm_set1_epi64x( qint64( Q_UINT64_C( 0x8000000000000000 ) ) );
+	const __m128i p = _mm_xor_si128( _mm_set1_epi64x( qint64( pivot ) ), bias );
+	while( k + 4 <= na )
+	{
+		const __m128i v0 = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)( a + k ) ), bias );
+		const __m128i v1 = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)( a + k + 2 ) ), bias );
+		const int mask = _mm_movemask_pd( _mm_castsi128_pd( _mm_cmpgt_epi64( p, v0 ) ) ) |
+				( _mm_movemask_pd( _mm_castsi128_pd( _mm_cmpgt_epi64( p, v1 ) ) ) << 2 );
+		if( mask != 0xf )
+			return k + _ctz( ~mask );
+		k += 4;
+	}
+	return _tailScalar( a, k, na, pivot );
+}
+
+#endif // FTS_X86
+
+template<class E>
+static int _intersect( const quint64* a, int na, const quint64* b, int nb, E& e )
+{
+#ifdef FTS_X86
+	switch( SetKernels::isa() )
+	{
+	case SetKernels::Avx2:
+		return _intersectAvx2( a, na, b, nb, e );
+	case SetKernels::Sse42:
+		return _intersectSse42( a, na, b, nb, e );
+	default:
+		break;
+	}
+#endif
+	return _intersectScalar( a, 0, na, b, 0, nb, e, 0 );
+}
+
+template<class E>
+static int _unite( const quint64* a, int na, const quint64* b, int nb, E& e )
+{
+#ifdef FTS_X86
+	switch( SetKernels::isa() )
+	{
+	case SetKernels::Avx2:
+		return _uniteRuns<E,_tailAvx2>( a, na, b, nb, e );
+	case SetKernels::Sse42:
+		return _uniteRuns<E,_tailSse42>( a, na, b, nb, e );
+	default:
+		break;
+	}
+#endif
+	return _uniteRuns<E,_tailScalar>( a, na, b, nb, e );
+}
+
+int SetKernels::intersect(const quint64* a, int na, const quint64* b, int nb, int* ia, int* ib)
+{
+	_PosOut e;
+	e.d_ia = ia;
+	e.d_ib = ib;
+	return _intersect( a, na, b, nb, e );
+}
+
+int SetKernels::unite(const quint64* a, int na, const quint64* b, int nb, int* ia, int* ib)
+{
+	_PosOut e;
+	e.d_ia = ia;
+	e.d_ib = ib;
+	return _unite( a, na, b, nb, e );
+}
+
+int SetKernels::intersect(const quint64* a, const quint32* ra, int na, const quint64* b, const quint32* rb, int nb,
+						  quint64* out, quint32* rout)
+{
+	_RankOut e;
+	e.d_a = a;
+	e.d_ra = ra;
+	e.d_b = b;
+	e.d_rb = rb;
+	e.d_out = out;
+	e.d_rout = rout;
+	return _intersect( a, na, b, nb, e );
+}
+
+int SetKernels::unite(const quint64* a, const quint32* ra, int na, const quint64* b, const quint32* rb, int nb,
+					  quint64* out, quint32* rout)
+{
+	_RankOut e;
+	e.d_a = a;
+	e.d_ra = ra;
+	e.d_b = b;
+	e.d_rb = rb;
+	e.d_out = out;
+	e.d_rout = rout;
+	return _unite( a, na, b, nb, e );
+}
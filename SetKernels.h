@@ -0,0 +1,49 @@
+#ifndef SETKERNELS_H
+#define SETKERNELS_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QtGlobal>
+
+namespace Fts
+{
+	// Schnittmenge und Vereinigung von aufsteigend sortierten, eindeutigen 64-bit Arrays (OIDs).
+	// Je nach CPU wird zur Laufzeit AVX2, SSE4.2 oder eine skalare Variante verwendet.
+	class SetKernels
+	{
+	public:
+		enum Isa { Scalar, Sse42, Avx2 };
+		static Isa isa(); // die tatsaechlich verwendete Variante
+		static void forceIsa( Isa ); // fuer Tests und Benchmarks; hoeher als isa() wird ignoriert
+
+		// Schreibt die Positionen gleicher Elemente nach ia/ib (je min(na,nb) Platz); gibt deren Anzahl zurueck
+		static int intersect( const quint64* a, int na, const quint64* b, int nb, int* ia, int* ib );
+		// Schreibt fuer jedes Element der Vereinigung die Position in a bzw. b oder -1 (je na+nb Platz)
+		static int unite( const quint64* a, int na, const quint64* b, int nb, int* ia, int* ib );
+
+		// Wie oben, aber mit den Raengen; gleiche Elemente erhalten die Summe der Raenge
+		static int intersect( const quint64* a, const quint32* ra, int na, const quint64* b, const quint32* rb, int nb,
+							  quint64* out, quint32* rout );
+		static int unite( const quint64* a, const quint32* ra, int na, const quint64* b, const quint32* rb, int nb,
+							  quint64* out, quint32* rout );
+	};
+}
+
+#endif // SETKERNELS_H
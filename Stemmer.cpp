@@ -35,6 +35,11 @@ Stemmer::Stemmer(QObject *parent) :
 {
 }
 
+Stemmer *Stemmer::clone() const
+{
+	return 0;
+}
+
 // ***************************************************************
 // German stemmer, adaptiert aus libstemmer http://snowball.tartarus.org/
 
@@ -552,6 +557,11 @@ GermanStemmer::~GermanStemmer()
 	german_ISO_8859_1_close_env(d_env);
 }
 
+Stemmer *GermanStemmer::clone() const
+{
+	return new GermanStemmer();
+}
+
 QString GermanStemmer::stem(const QString & str) const
 {
 	const QByteArray utf8 = str.toUtf8();
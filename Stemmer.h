@@ -32,6 +32,7 @@ namespace Fts
 		explicit Stemmer(QObject *parent = 0);
 		// to override
 		virtual QString stem( const QString& ) const = 0;
+		virtual Stemmer* clone() const; // fuer einen anderen Thread, da stem trotz const Zustand haben darf; 0..nicht unterstuetzt
 	};
 
 	class GermanStemmer : public Stemmer
@@ -41,6 +42,7 @@ namespace Fts
 		~GermanStemmer();
 		// override
 		QString stem( const QString& ) const;
+		Stemmer* clone() const; // mit eigenem SN_env
 	private:
 		SN_env* d_env;
 	};
@@ -26,6 +26,11 @@ Stopper::Stopper(QObject *parent) :
 {
 }
 
+Stopper *Stopper::clone() const
+{
+	return 0;
+}
+
 // ******************************************************************************
 static const char *words_de[] = {
 	"aber", "alle", "allem", "allen", "aller", "alles", "als", "also", "am",
@@ -92,6 +97,11 @@ GermanStopper::GermanStopper(QObject * p):Stopper(p)
 //		d_hash.insert( QString::fromUtf8( words_en[i] ) );
 }
 
+Stopper *GermanStopper::clone() const
+{
+	return new GermanStopper(0);
+}
+
 bool GermanStopper::isStopword(const QString & str)
 {
 	return d_hash.contains( str );
@@ -31,6 +31,7 @@ namespace Fts
 		explicit Stopper(QObject *parent = 0);
 		// to override
 		virtual bool isStopword( const QString& ) = 0;
+		virtual Stopper* clone() const; // fuer die Threads von reindexAll; 0..nicht unterstuetzt, dann indiziert es sequentiell
 	};
 
 	class GermanStopper : public Stopper
@@ -39,6 +40,7 @@ namespace Fts
 		GermanStopper( QObject* );
 		// override
 		bool isStopword( const QString& );
+		Stopper* clone() const;
 	private:
 		QSet<QString> d_hash;
 	};
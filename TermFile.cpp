@@ -0,0 +1,280 @@
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "TermFile.h"
+#include <QtDebug>
+#include <string.h>
+using namespace Fts;
+
+// Kopf: Magic, Version, Snapshot, Anzahl Eintraege, Anzahl Bloecke, Offset des Verzeichnisses; je 32 Bit LE
+static const char s_magic[] = "FTSD";
+static const quint32 s_version = 1;
+static const int s_headSize = 24;
+
+static quint32 _readU32( const uchar* p )
+{
+	return quint32(p[0]) | ( quint32(p[1]) << 8 ) | ( quint32(p[2]) << 16 ) | ( quint32(p[3]) << 24 );
+}
+
+static void _writeU32( QByteArray& out, quint32 v )
+{
+	for( int i = 0; i < 4; i++ )
+		out.append( char( ( v >> ( 8 * i ) ) & 0xff ) );
+}
+
+static void _writeVar( QByteArray& out, quint32 v )
+{
+	while( v >= 0x80 )
+	{
+		out.append( char( ( v & 0x7f ) | 0x80 ) );
+		v >>= 7;
+	}
+	out.append( char( v ) );
+}
+
+static inline const uchar* _readVar( const uchar* p, const uchar* end, quint32& v )
+{
+	// Hoechstens fuenf Bytes und nie ueber end hinaus, auch wenn die Datei beschaedigt ist
+	v = 0;
+	for( int i = 0; i < 5 && p < end; i++ )
+	{
+		const uchar b = *p++;
+		v |= quint32( b & 0x7f ) << ( 7 * i );
+		if( ( b & 0x80 ) == 0 )
+			break;
+	}
+	return p;
+}
+
+static int _compare( const char* a, int na, const char* b, int nb )
+{
+	const int res = ::memcmp( a, b, qMin( na, nb ) );
+	if( res != 0 )
+		return res;
+	return na - nb;
+}
+
+TermFile::TermFile():d_data(0),d_size(0),d_snapshot(0),d_count(0),d_blockCount(0),d_index(0)
+{
+}
+
+TermFile::~TermFile()
+{
+	close();
+}
+
+bool TermFile::open(const QString & path)
+{
+	close();
+	d_file.setFileName( path );
+	if( !d_file.open( QIODevice::ReadOnly ) )
+		return false;
+	d_size = d_file.size();
+	const uchar* data = ( d_size >= s_headSize ) ? d_file.map( 0, d_size ) : 0;
+	if( data == 0 || ::memcmp( data, s_magic, 4 ) != 0 || _readU32( data + 4 ) != s_version )
+	{
+		qWarning() << "TermFile::open: invalid file" << path;
+		if( data )
+			d_file.unmap( const_cast<uchar*>( data ) );
+		d_file.close();
+		return false;
+	}
+	d_snapshot = _readU32( data + 8 );
+	d_count = _readU32( data + 12 );
+	d_blockCount = _readU32( data + 16 );
+	d_index = _readU32( data + 20 );
+	if( qint64(d_index) + 4 * qint64(d_blockCount) != d_size || d_index < quint32(s_headSize) ||
+			d_blockCount != ( qint64(d_count) + BlockSize - 1 ) / BlockSize )
+	{
+		qWarning() << "TermFile::open: truncated file" << path;
+		d_file.unmap( const_cast<uchar*>( data ) );
+		d_file.close();
+		return false;
+	}
+	for( quint32 b = 0; b < d_blockCount; b++ )
+	{
+		const quint32 off = _readU32( data + d_index + 4 * b );
+		if( off < quint32(s_headSize) || off >= d_index )
+		{
+			qWarning() << "TermFile::open: invalid block offset" << path;
+			d_file.unmap( const_cast<uchar*>( data ) );
+			d_file.close();
+			return false;
+		}
+	}
+	d_data = data;
+	return true;
+}
+
+void TermFile::close()
+{
+	if( d_data )
+		d_file.unmap( const_cast<uchar*>( d_data ) );
+	d_data = 0;
+	d_file.close();
+	d_size = 0;
+	d_count = d_blockCount = d_snapshot = d_index = 0;
+}
+
+const uchar *TermFile::block(quint32 b) const
+{
+	return d_data + _readU32( d_data + d_index + 4 * b );
+}
+
+int TermFile::compareFirst(quint32 b, const char * key, int len) const
+{
+	const uchar* end = d_data + d_index;
+	quint32 prefix, n;
+	const uchar* p = _readVar( block( b ), end, prefix ); // immer 0
+	p = _readVar( p, end, n );
+	n = qMin( n, quint32( end - p ) );
+	return _compare( reinterpret_cast<const char*>( p ), n, key, len );
+}
+
+quint32 TermFile::findBlock(const char * key, int len) const
+{
+	quint32 lo = 0, hi = d_blockCount;
+	while( lo < hi )
+	{
+		const quint32 mid = lo + ( hi - lo ) / 2;
+		if( compareFirst( mid, key, len ) <= 0 )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return ( lo == 0 ) ? 0 : lo - 1;
+}
+
+bool TermFile::find(const QByteArray & key, quint32 & tid, quint32 & df) const
+{
+	if( d_data == 0 || d_blockCount == 0 )
+		return false;
+	Iterator i( this );
+	i.seek( key );
+	if( i.atEnd() || _compare( i.key(), i.keySize(), key.constData(), key.size() ) != 0 )
+		return false;
+	tid = i.tid();
+	df = i.df();
+	return true;
+}
+
+bool TermFile::write(const QString & path, quint32 snapshot, const QList<TermFile::Entry> & entries)
+{
+	QByteArray out;
+	out.append( s_magic, 4 );
+	_writeU32( out, s_version );
+	_writeU32( out, snapshot );
+	_writeU32( out, entries.size() );
+	const quint32 blocks = ( entries.size() + BlockSize - 1 ) / BlockSize;
+	_writeU32( out, blocks );
+	_writeU32( out, 0 ); // Offset des Verzeichnisses, unten gesetzt
+	QList<quint32> offsets;
+	for( int i = 0; i < entries.size(); i++ )
+	{
+		const QByteArray& key = entries[i].d_key;
+		int prefix = 0;
+		if( i % BlockSize == 0 )
+			offsets.append( out.size() );
+		else
+		{
+			const QByteArray& prev = entries[i-1].d_key;
+			Q_ASSERT( _compare( prev.constData(), prev.size(), key.constData(), key.size() ) < 0 );
+			while( prefix < prev.size() && prefix < key.size() && prev[prefix] == key[prefix] )
+				prefix++;
+		}
+		_writeVar( out, prefix );
+		_writeVar( out, key.size() - prefix );
+		out.append( key.constData() + prefix, key.size() - prefix );
+		_writeVar( out, entries[i].d_tid );
+		_writeVar( out, entries[i].d_df );
+	}
+	const quint32 index = out.size();
+	for( int i = 0; i < offsets.size(); i++ )
+		_writeU32( out, offsets[i] );
+	for( int i = 0; i < 4; i++ )
+		out[20 + i] = char( ( index >> ( 8 * i ) ) & 0xff );
+
+	const QString tmp = path + QLatin1String(".tmp");
+	QFile f( tmp );
+	if( !f.open( QIODevice::WriteOnly ) || f.write( out ) != out.size() || !f.flush() )
+	{
+		qWarning() << "TermFile::write: cannot write" << tmp << f.errorString();
+		f.close();
+		QFile::remove( tmp );
+		return false;
+	}
+	f.close();
+	QFile::remove( path );
+	return QFile::rename( tmp, path );
+}
+
+TermFile::Iterator::Iterator(const TermFile * f):d_file(f),d_block(0),d_pos(0),d_next(0),d_tid(0),d_df(0)
+{
+	gotoBlock( 0 );
+}
+
+void TermFile::Iterator::gotoBlock(quint32 b)
+{
+	d_block = b;
+	d_pos = 0;
+	d_key.clear();
+	if( d_block < d_file->d_blockCount )
+	{
+		d_next = d_file->block( d_block );
+		readEntry();
+	}
+}
+
+void TermFile::Iterator::readEntry()
+{
+	const uchar* end = d_file->d_data + d_file->d_index;
+	quint32 prefix, n;
+	const uchar* p = _readVar( d_next, end, prefix );
+	p = _readVar( p, end, n );
+	prefix = qMin( prefix, quint32( d_key.size() ) );
+	n = qMin( n, quint32( end - p ) );
+	d_key.resize( prefix + n );
+	::memcpy( d_key.data() + prefix, p, n );
+	p = _readVar( p + n, end, d_tid );
+	d_next = _readVar( p, end, d_df );
+}
+
+void TermFile::Iterator::next()
+{
+	if( atEnd() )
+		return;
+	d_pos++;
+	const quint32 global = d_block * BlockSize + d_pos;
+	if( d_pos >= quint32(BlockSize) || global >= d_file->d_count )
+		gotoBlock( d_block + 1 );
+	else
+		readEntry();
+}
+
+void TermFile::Iterator::seek(const QByteArray & key)
+{
+	if( d_file->d_blockCount == 0 )
+		return;
+	const quint32 b = d_file->findBlock( key.constData(), key.size() );
+	// vorwaerts im selben Block weiterlesen, sonst am Anfang des Blocks beginnen
+	if( b != d_block || _compare( d_key.constData(), d_key.size(), key.constData(), key.size() ) > 0 )
+		gotoBlock( b );
+	while( !atEnd() && _compare( d_key.constData(), d_key.size(), key.constData(), key.size() ) < 0 )
+		next();
+}
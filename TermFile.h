@@ -0,0 +1,96 @@
+#ifndef TERMFILE_H
+#define TERMFILE_H
+
+/*
+* Copyright 2016-2017 Rochus Keller <mailto:me@rochus-keller.info>
+*
+* This file is part of the CrossLine full-text search Fts library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.info.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QFile>
+#include <QByteArray>
+#include <QList>
+#include <QVarLengthArray>
+
+namespace Fts
+{
+	// Unveraenderliche Kopie des Dictionary (Schluessel -> Term-ID und df) in einer Datei, die per mmap
+	// gelesen wird. Die Schluessel sind wie in Udb::Global bytewise sortiert und in Bloecken zu BlockSize
+	// Eintraegen front-kodiert: Laenge des mit dem Vorgaenger gemeinsamen Anfangs, Rest, Term-ID und df als
+	// Varint. Der erste Eintrag eines Blocks ist vollstaendig; ein Verzeichnis am Ende enthaelt die Offsets
+	// der Bloecke. Suchen ist eine binaere Suche ueber die ersten Schluessel der Bloecke und ein Lauf durch
+	// einen Block, ohne Allokation fuer Schluessel bis KeyBuf Bytes.
+	class TermFile
+	{
+	public:
+		enum { BlockSize = 32, KeyBuf = 128 };
+		struct Entry
+		{
+			QByteArray d_key;
+			quint32 d_tid;
+			quint32 d_df;
+		};
+		TermFile();
+		~TermFile();
+		bool open( const QString& path );
+		void close();
+		bool isOpen() const { return d_data != 0; }
+		QString getPath() const { return d_file.fileName(); }
+		quint32 getSnapshot() const { return d_snapshot; } // siehe IndexEngine::writeTermFile
+		quint32 getCount() const { return d_count; }
+		bool find( const QByteArray& key, quint32& tid, quint32& df ) const;
+		// schreibt zuerst in path.tmp und benennt erst am Schluss um; die Eintraege muessen sortiert sein
+		static bool write( const QString& path, quint32 snapshot, const QList<Entry>& );
+
+		class Iterator
+		{
+		public:
+			Iterator( const TermFile* );
+			void seek( const QByteArray& ); // erster Schluessel >= key
+			bool atEnd() const { return d_block >= d_file->d_blockCount; }
+			void next();
+			const char* key() const { return d_key.constData(); }
+			int keySize() const { return d_key.size(); }
+			QByteArray getKey() const { return QByteArray( d_key.constData(), d_key.size() ); }
+			quint32 tid() const { return d_tid; }
+			quint32 df() const { return d_df; }
+		private:
+			void readEntry();
+			void gotoBlock( quint32 );
+			const TermFile* d_file;
+			quint32 d_block;
+			quint32 d_pos; // Eintrag im Block
+			const uchar* d_next; // naechster Eintrag
+			QVarLengthArray<char,KeyBuf> d_key;
+			quint32 d_tid;
+			quint32 d_df;
+		};
+	private:
+		friend class Iterator;
+		int compareFirst( quint32 block, const char* key, int len ) const;
+		quint32 findBlock( const char* key, int len ) const; // letzter Block mit erstem Schluessel <= key
+		const uchar* block( quint32 b ) const;
+		QFile d_file;
+		const uchar* d_data;
+		qint64 d_size;
+		quint32 d_snapshot;
+		quint32 d_count;
+		quint32 d_blockCount;
+		quint32 d_index; // Offset des Verzeichnisses
+	};
+}
+
+#endif // TERMFILE_H
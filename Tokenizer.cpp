@@ -25,6 +25,11 @@ Tokenizer::Tokenizer(QObject *parent) :
 {
 }
 
+Tokenizer *Tokenizer::clone() const
+{
+	return 0;
+}
+
 LetterOrNumberTok::LetterOrNumberTok(QObject *p):Tokenizer(p),d_pos(0)
 {
 }
@@ -42,6 +47,11 @@ QStringList LetterOrNumberTok::parse(const QString & str)
 	return res;
 }
 
+Tokenizer *LetterOrNumberTok::clone() const
+{
+	return new LetterOrNumberTok();
+}
+
 void LetterOrNumberTok::setString(const QString & str)
 {
 	d_pos = 0;
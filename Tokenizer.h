@@ -31,6 +31,7 @@ namespace Fts
 		// to override
 		virtual void setString( const QString& ) = 0;
 		virtual QString nextToken() = 0; // Gibt ein Token (lowercase) nach dem anderen zurck bis Leerstring
+		virtual Tokenizer* clone() const; // mit eigenem Zustand fuer setString/nextToken; 0..nicht unterstuetzt
 	};
 
 	class LetterOrNumberTok : public Tokenizer
@@ -41,6 +42,7 @@ namespace Fts
 		// override
 		void setString( const QString& );
 		QString nextToken();
+		Tokenizer* clone() const;
 	private:
 		QString d_str;
 		int d_pos;